@@ -1,10 +1,26 @@
 #pragma once
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <deque>
 #include <iterator>
 #include <memory>
+#include <numeric>
 #include <stdexcept>
 #include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+#ifdef ANY_ITERATOR_STATS
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <typeindex>
+#endif
 
 namespace any_iterator_impl
 {
@@ -19,716 +35,2031 @@ struct bad_any_iterator : std::exception
     }
 };
 
+#ifdef ANY_ITERATOR_STATS
+// Hot path instrumentation, compiled in only when ANY_ITERATOR_STATS is
+// defined. Every thread counts into its own counters, snapshot() sums the
+// counters of all live threads and of the threads that already exited.
+namespace stats
+{
+enum class op
+{
+    copy, move, assign, destroy,
+    deref, preinc, postinc, eq, next_batch, deref_inc, next, next_prefetched,
+    predec, postdec,
+    add, sub, diff, lt, subscript, contiguous_data,
+    at_end, put, sentinel_eq,
+    count
+};
+
+enum class allocation
+{
+    construct, copy, assign, postinc, postdec, unshare,
+    count
+};
+
+constexpr char const* op_names[] =
+{
+    "copy", "move", "assign", "destroy",
+    "deref", "preinc", "postinc", "eq", "next_batch", "deref_inc", "next", "next_prefetched",
+    "predec", "postdec",
+    "add", "sub", "diff", "lt", "subscript", "contiguous_data",
+    "at_end", "put", "sentinel_eq"
+};
+
+constexpr char const* allocation_names[] =
+{
+    "construct", "copy", "assign", "postinc", "postdec", "unshare"
+};
+
+// constructions of any_iterators from one inner iterator type, split by
+// whether the inner iterator went to the small buffer or to the heap
+struct type_counters
+{
+    size_t inline_constructions = 0;
+    size_t heap_constructions = 0;
+};
+
+struct summary
+{
+    size_t ops[static_cast<size_t>(op::count)] = {};
+    size_t allocations[static_cast<size_t>(allocation::count)] = {};
+    std::map<std::string, type_counters> types;
+
+    void add(summary const& other)
+    {
+        for (size_t i = 0; i != static_cast<size_t>(op::count); ++i)
+            ops[i] += other.ops[i];
+        for (size_t i = 0; i != static_cast<size_t>(allocation::count); ++i)
+            allocations[i] += other.allocations[i];
+        for (auto const& type : other.types)
+        {
+            type_counters& counters = types[type.first];
+            counters.inline_constructions += type.second.inline_constructions;
+            counters.heap_constructions += type.second.heap_constructions;
+        }
+    }
+};
+
+struct thread_counters;
+
+struct registry
+{
+    std::mutex mutex;
+    std::vector<thread_counters*> threads;
+    summary retired;
+};
+
+inline registry& get_registry()
+{
+    static registry instance;
+    return instance;
+}
+
+struct thread_counters
+{
+    // only the owning thread writes the counters, so a relaxed load and
+    // store is enough and avoids locked instructions on the hot path
+    std::atomic<size_t> ops[static_cast<size_t>(op::count)] = {};
+    std::atomic<size_t> allocations[static_cast<size_t>(allocation::count)] = {};
+
+    std::mutex types_mutex;
+    std::map<std::type_index, type_counters> types;
+
+    thread_counters()
+    {
+        registry& r = get_registry();
+        std::lock_guard<std::mutex> lg(r.mutex);
+        r.threads.push_back(this);
+    }
+
+    ~thread_counters()
+    {
+        registry& r = get_registry();
+        std::lock_guard<std::mutex> lg(r.mutex);
+        r.threads.erase(std::find(r.threads.begin(), r.threads.end(), this));
+        r.retired.add(collect());
+    }
+
+    summary collect()
+    {
+        summary result;
+        for (size_t i = 0; i != static_cast<size_t>(op::count); ++i)
+            result.ops[i] = ops[i].load(std::memory_order_relaxed);
+        for (size_t i = 0; i != static_cast<size_t>(allocation::count); ++i)
+            result.allocations[i] = allocations[i].load(std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lg(types_mutex);
+        for (auto const& type : types)
+            result.types[type.first.name()] = type.second;
+        return result;
+    }
+};
+
+inline thread_counters& local_counters()
+{
+    static thread_local thread_counters instance;
+    return instance;
+}
+
+inline void bump(std::atomic<size_t>& counter)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+inline void record_op(op o)
+{
+    bump(local_counters().ops[static_cast<size_t>(o)]);
+}
+
+inline void record_allocation(allocation a)
+{
+    bump(local_counters().allocations[static_cast<size_t>(a)]);
+}
+
+inline void record_construct(std::type_info const& type, bool heap)
+{
+    thread_counters& counters = local_counters();
+    std::lock_guard<std::mutex> lg(counters.types_mutex);
+    type_counters& tc = counters.types[type];
+    ++(heap ? tc.heap_constructions : tc.inline_constructions);
+}
+
+inline summary snapshot()
+{
+    registry& r = get_registry();
+    std::lock_guard<std::mutex> lg(r.mutex);
+    summary result = r.retired;
+    for (thread_counters* t : r.threads)
+        result.add(t->collect());
+    return result;
+}
+
+inline void dump(std::ostream& os)
+{
+    summary s = snapshot();
+
+    os << "any_iterator ops:\n";
+    for (size_t i = 0; i != static_cast<size_t>(op::count); ++i)
+        os << "  " << op_names[i] << ": " << s.ops[i] << "\n";
+
+    os << "any_iterator heap allocations:\n";
+    for (size_t i = 0; i != static_cast<size_t>(allocation::count); ++i)
+        os << "  " << allocation_names[i] << ": " << s.allocations[i] << "\n";
+
+    os << "any_iterator inner iterator types (inline/heap constructions):\n";
+    for (auto const& type : s.types)
+        os << "  " << type.first << ": " << type.second.inline_constructions
+           << "/" << type.second.heap_constructions << "\n";
+}
+}
+
+#define ANY_ITERATOR_STATS_OP(name) ::any_iterator_impl::stats::record_op(::any_iterator_impl::stats::op::name)
+#define ANY_ITERATOR_STATS_ALLOCATION(site) ::any_iterator_impl::stats::record_allocation(::any_iterator_impl::stats::allocation::site)
+#define ANY_ITERATOR_STATS_CONSTRUCT(type, heap) ::any_iterator_impl::stats::record_construct(typeid(type), heap)
+#else
+#define ANY_ITERATOR_STATS_OP(name) ((void)0)
+#define ANY_ITERATOR_STATS_ALLOCATION(site) ((void)0)
+#define ANY_ITERATOR_STATS_CONSTRUCT(type, heap) ((void)0)
+#endif
+
+// Storage policy of any_iterator: inner iterators that are nothrow movable
+// and fit into Size bytes with at most Alignment alignment are stored inline,
+// bigger ones are allocated with Allocator (rebound to the inner iterator
+// type) and only a pointer is kept inline. The allocator is default
+// constructed on every use, so it must be stateless.
+template <size_t Size, size_t Alignment = alignof(void*), typename Allocator = std::allocator<char> >
+struct inline_storage
+{
+    static_assert(Size >= sizeof(void*), "inline storage must be able to hold a pointer");
+    static_assert(Alignment >= alignof(void*), "inline storage must be aligned at least as a pointer");
+
+    static constexpr size_t size = Size;
+    static constexpr size_t alignment = Alignment;
+    using allocator_type = Allocator;
+    static constexpr bool inline_hot_ops = false;
+    // every copy of a heap inner iterator gets its own block
+    using shared_counter = void;
+    // inline inner iterators may need their move constructor to move
+    static constexpr bool trivially_relocatable = false;
+
+    alignas(Alignment) unsigned char data[Size];
+};
+
+using default_storage = inline_storage<sizeof(void*)>;
+
+// Storage policy that behaves as Storage and additionally keeps copies of the
+// deref, preinc and eq entries of the ops table in every any_iterator. This
+// costs three pointers per iterator and removes the load of the ops pointer
+// from the dependency chain of these operations, which pays off in pointer
+// chasing loops such as list traversals.
+template <typename Storage>
+struct hot_ops_storage : Storage
+{
+    static constexpr bool inline_hot_ops = true;
+};
+
+// Storage policy that behaves as Storage except that inner iterators too big
+// for it live in a reference counted block shared by copies of the
+// any_iterator. Copies only bump the count, an operation that changes the
+// inner iterator clones the block first if it is shared. A size_t Counter
+// is for iterators whose copies stay on one thread, std::atomic<size_t>
+// lets copies of one iterator be used and destroyed on different threads.
+template <typename Storage, typename Counter = size_t>
+struct shared_storage : Storage
+{
+    using shared_counter = Counter;
+};
+
+// Storage policy that behaves as Storage except that only trivially
+// relocatable inner iterators are kept inline, others are kept behind a
+// pointer. The storage is then always moved by copying its bytes, and the
+// any_iterators using it are trivially relocatable themselves.
+template <typename Storage>
+struct relocatable_storage : Storage
+{
+    static constexpr bool trivially_relocatable = true;
+};
+
+// Stateless allocator that keeps a per-thread free list for every type it is
+// rebound to. Single-object allocations after warm up are O(1) and don't
+// touch the global allocator. Blocks freed on another thread join that
+// thread's free list and are released when the thread exits.
+template <typename T>
+struct pooled_allocator
+{
+    using value_type = T;
+
+    pooled_allocator() noexcept
+    {}
+
+    template <typename U>
+    pooled_allocator(pooled_allocator<U> const&) noexcept
+    {}
+
+    T* allocate(size_t n)
+    {
+        if (n != 1)
+            return std::allocator<T>().allocate(n);
+
+        free_list& list = local_free_list();
+        if (!list.head)
+            return reinterpret_cast<T*>(new block);
+
+        block* b = list.head;
+        list.head = b->next;
+        return reinterpret_cast<T*>(b);
+    }
+
+    void deallocate(T* p, size_t n) noexcept
+    {
+        if (n != 1)
+        {
+            std::allocator<T>().deallocate(p, n);
+            return;
+        }
+
+        free_list& list = local_free_list();
+        block* b = reinterpret_cast<block*>(p);
+        b->next = list.head;
+        list.head = b;
+    }
+
+    friend bool operator==(pooled_allocator const&, pooled_allocator const&) noexcept
+    {
+        return true;
+    }
+
+    friend bool operator!=(pooled_allocator const&, pooled_allocator const&) noexcept
+    {
+        return false;
+    }
+
+private:
+    union block
+    {
+        block* next;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type value;
+    };
+
+    struct free_list
+    {
+        block* head = nullptr;
+
+        ~free_list()
+        {
+            while (head)
+                delete std::exchange(head, head->next);
+        }
+    };
+
+    static free_list& local_free_list()
+    {
+        static thread_local free_list instance;
+        return instance;
+    }
+};
+
+template <size_t Size, size_t Alignment = alignof(void*)>
+using pooled_storage = inline_storage<Size, Alignment, pooled_allocator<char> >;
+
+// Input iterators return their elements by value by default: most of them
+// produce elements on the fly and have nothing to refer to.
 template <typename ValueType, typename Category>
+struct default_reference
+{
+    using type = typename std::conditional<std::is_same<Category, std::input_iterator_tag>::value, ValueType, ValueType&>::type;
+};
+
+// Reference is what dereferencing returns. It is ValueType& by default and
+// ValueType for input iterators, a by-value type such as ValueType allows
+// generators and transforming iterators, a proxy type allows iterators like
+// std::vector<bool>'s.
+template <typename ValueType, typename Category, typename Storage = default_storage,
+          typename Reference = typename default_reference<ValueType, Category>::type>
 struct any_iterator;
 
-template <typename InnerIterator>
+template <typename ValueType, typename Category, typename Storage = default_storage, typename Reference = ValueType&>
+struct any_range;
+
+template <typename ValueType, typename Storage = default_storage, typename Reference = ValueType&>
+struct any_sentinel;
+
+// any_iterators over ValueType const share the ops tables of the ones over
+// ValueType, so adding const is a copy of the ops pointer and the storage.
+// The tables return non-const references, which the iterators make const.
+template <typename ValueType, typename Reference>
+struct erased_types
+{
+    using value_type = ValueType;
+    using reference = Reference;
+};
+
+template <typename ValueType>
+struct erased_types<ValueType const, ValueType const&>
+{
+    using value_type = ValueType;
+    using reference = ValueType&;
+};
+
+// true if InnerIterator is an any_iterator sharing the ops tables of
+// any_iterator<ValueType, ..., Storage, Reference>, these are converted
+// without wrapping. Other any_iterators are wrapped as inner iterators.
+template <typename InnerIterator, typename ValueType, typename Storage, typename Reference>
 struct is_any_iterator
 {
     static constexpr bool value = false;
 };
 
-template <typename ValueType, typename Category>
-struct is_any_iterator<any_iterator<ValueType, Category> >
+template <typename OtherValueType, typename Category, typename Storage, typename OtherReference, typename ValueType, typename Reference>
+struct is_any_iterator<any_iterator<OtherValueType, Category, Storage, OtherReference>, ValueType, Storage, Reference>
+{
+    static constexpr bool value = std::is_same<typename erased_types<OtherValueType, OtherReference>::value_type,
+                                               typename erased_types<ValueType, Reference>::value_type>::value
+                               && std::is_same<typename erased_types<OtherValueType, OtherReference>::reference,
+                                               typename erased_types<ValueType, Reference>::reference>::value;
+};
+
+// true for any_iterators of any layout
+template <typename InnerIterator>
+struct is_wrapped_any_iterator
+{
+    static constexpr bool value = false;
+};
+
+template <typename ValueType, typename Category, typename Storage, typename Reference>
+struct is_wrapped_any_iterator<any_iterator<ValueType, Category, Storage, Reference> >
 {
     static constexpr bool value = true;
 };
 
-constexpr size_t small_storage_size = sizeof(void*);
-constexpr size_t small_storage_alignment = alignof(void*);
-using small_storage_type = std::aligned_storage<small_storage_size, small_storage_alignment>::type;
+// true if InnerIterator is an any_contiguous_iterator, which holds a plain
+// pointer instead of an ops table and storage
+template <typename InnerIterator>
+struct is_any_contiguous_iterator
+{
+    static constexpr bool value = false;
+};
+
+#if defined(__cpp_lib_concepts)
+template <typename ValueType, typename Storage>
+struct is_any_contiguous_iterator<any_iterator<ValueType, std::contiguous_iterator_tag, Storage, ValueType&> >
+{
+    static constexpr bool value = true;
+};
+#endif
 
-template <typename ValueType, typename Category>
+template <typename ValueType, typename Category, typename Storage, typename Reference = ValueType&>
 struct any_iterator_ops;
 
-template <typename ValueType>
-struct any_iterator_ops<ValueType, std::forward_iterator_tag>
-{
-    using copy_t = void (*)(small_storage_type& dst, small_storage_type const& src);
-    using move_t  = void (*)(small_storage_type& dst, small_storage_type& src);
-    using assign_t = void (*)(any_iterator_ops<ValueType, std::forward_iterator_tag> const* dst_ops,
-                              small_storage_type& dst, small_storage_type const& src);
-    using destroy_t = void (*)(small_storage_type& obj);
 
-    using deref_t = ValueType& (*)(small_storage_type const& obj);
-    using preinc_t = void (*)(small_storage_type& obj);
-    using postinc_t = void (*)(small_storage_type& dst, small_storage_type& src);
+template <typename ValueType, typename Category, typename Storage, typename Reference>
+using erased_ops = any_iterator_ops<typename erased_types<ValueType, Reference>::value_type, Category, Storage,
+                                    typename erased_types<ValueType, Reference>::reference>;
+
+constexpr size_t cache_line_size = 64;
+
+// Standard algorithms instantiated for an inner iterator type, so that an
+// algorithm over a range of any_iterators makes one indirect call per range
+// instead of one or more per element. An entry is null if the elements lack
+// the operator the algorithm needs.
+template <typename ValueType, typename Storage>
+struct any_iterator_algorithms
+{
+    using value_type = typename std::remove_cv<ValueType>::type;
 
-    using eq_t = bool (*)(small_storage_type const& lhs, small_storage_type const& rhs);
+    // find and lower_bound move first to the result
+    using find_t = void (*)(Storage& first, Storage const& last, value_type const& value);
+    using count_t = std::ptrdiff_t (*)(Storage const& first, Storage const& last, value_type const& value);
+    // adds the elements to acc
+    using accumulate_t = void (*)(Storage const& first, Storage const& last, value_type& acc);
+    using copy_t = value_type* (*)(Storage const& first, Storage const& last, value_type* out);
+    using equal_t = bool (*)(Storage const& first1, Storage const& last1, Storage const& first2);
+    using lower_bound_t = void (*)(Storage& first, Storage const& last, value_type const& value);
 
+    find_t find;
+    count_t count;
+    accumulate_t accumulate;
     copy_t copy;
-    move_t move;
-    assign_t assign;
-    destroy_t destroy;
+    equal_t equal;
+    lower_bound_t lower_bound;
+
+    constexpr any_iterator_algorithms(find_t find, count_t count, accumulate_t accumulate,
+                                      copy_t copy, equal_t equal, lower_bound_t lower_bound)
+        : find(find)
+        , count(count)
+        , accumulate(accumulate)
+        , copy(copy)
+        , equal(equal)
+        , lower_bound(lower_bound)
+    {}
+};
 
+template <typename ValueType, typename Storage, typename Reference>
+struct any_iterator_ops<ValueType, std::forward_iterator_tag, Storage, Reference>
+{
+    using copy_t = void (*)(Storage& dst, Storage const& src);
+    // null if the storage can be moved by copying its bytes
+    using move_t = void (*)(Storage& dst, Storage& src);
+    using assign_t = void (*)(any_iterator_ops<ValueType, std::forward_iterator_tag, Storage, Reference> const* dst_ops,
+                              Storage& dst, Storage const& src);
+    using destroy_t = void (*)(Storage& obj);
+    // null for empty any_iterators
+    using algorithms_t = any_iterator_algorithms<ValueType, Storage> const*;
+
+    using deref_t = Reference (*)(Storage const& obj);
+    using preinc_t = void (*)(Storage& obj);
+    using postinc_t = void (*)(Storage& dst, Storage& src);
+
+    using eq_t = bool (*)(Storage const& lhs, Storage const& rhs);
+    // null unless Reference is ValueType&
+    using next_batch_t = size_t (*)(Storage& obj, Storage const& end, ValueType** out, size_t n);
+
+    // deref followed by preinc, and eq with end followed by both
+    using deref_inc_t = Reference (*)(Storage& obj);
+    // null unless Reference is ValueType&
+    using next_t = ValueType* (*)(Storage& obj, Storage const& end);
+    // next that also advances a look-ahead cursor and prefetches the node
+    // it reaches; null unless the inner iterator chases pointers and
+    // Reference is ValueType&
+    using next_prefetched_t = ValueType* (*)(Storage& obj, Storage& ahead, Storage const& end);
+
+    // The entries used by every step of a traversal come first, so that
+    // they share a cache line. Tables are allocated at a cache line boundary.
     deref_t deref;
     preinc_t preinc;
+    eq_t eq;
+    deref_inc_t deref_inc;
+    next_t next;
     postinc_t postinc;
+    next_batch_t next_batch;
+    next_prefetched_t next_prefetched;
 
-    eq_t eq;
+    std::type_info const* type;
+
+    copy_t copy;
+    move_t move;
+    assign_t assign;
+    destroy_t destroy;
+    algorithms_t algorithms;
 
-    constexpr any_iterator_ops(copy_t copy, move_t move, assign_t assign,
-                               destroy_t destroy,
+    constexpr any_iterator_ops(std::type_info const* type,
+                               copy_t copy, move_t move, assign_t assign,
+                               destroy_t destroy, algorithms_t algorithms,
                                deref_t deref, preinc_t preinc, postinc_t postinc,
-                               eq_t eq)
-        : copy(copy)
+                               eq_t eq, next_batch_t next_batch,
+                               deref_inc_t deref_inc, next_t next, next_prefetched_t next_prefetched)
+        : deref(deref)
+        , preinc(preinc)
+        , eq(eq)
+        , deref_inc(deref_inc)
+        , next(next)
+        , postinc(postinc)
+        , next_batch(next_batch)
+        , next_prefetched(next_prefetched)
+        , type(type)
+        , copy(copy)
         , move(move)
         , assign(assign)
         , destroy(destroy)
-        , deref(deref)
-        , preinc(preinc)
-        , postinc(postinc)
-        , eq(eq)
+        , algorithms(algorithms)
     {}
 };
 
-template <typename ValueType>
-struct any_iterator_ops<ValueType, std::bidirectional_iterator_tag> : any_iterator_ops<ValueType, std::forward_iterator_tag>
+template <typename ValueType, typename Storage, typename Reference>
+struct any_iterator_ops<ValueType, std::bidirectional_iterator_tag, Storage, Reference> : any_iterator_ops<ValueType, std::forward_iterator_tag, Storage, Reference>
 {
-    using base = any_iterator_ops<ValueType, std::forward_iterator_tag>;
+    using base = any_iterator_ops<ValueType, std::forward_iterator_tag, Storage, Reference>;
     using typename base::copy_t;
     using typename base::move_t;
     using typename base::assign_t;
     using typename base::destroy_t;
+    using typename base::algorithms_t;
     using typename base::deref_t;
     using typename base::preinc_t;
     using typename base::postinc_t;
     using typename base::eq_t;
+    using typename base::next_batch_t;
+    using typename base::deref_inc_t;
+    using typename base::next_t;
+    using typename base::next_prefetched_t;
 
-    using predec_t = void (*)(small_storage_type& obj);
-    using postdec_t = void (*)(small_storage_type& dst, small_storage_type& src);
+    using predec_t = void (*)(Storage& obj);
+    using postdec_t = void (*)(Storage& dst, Storage& src);
 
     predec_t predec;
     postdec_t postdec;
 
-    constexpr any_iterator_ops(copy_t copy, move_t move, assign_t assign,
-                               destroy_t destroy,
+    constexpr any_iterator_ops(std::type_info const* type,
+                               copy_t copy, move_t move, assign_t assign,
+                               destroy_t destroy, algorithms_t algorithms,
                                deref_t deref, preinc_t preinc, postinc_t postinc,
-                               eq_t eq, predec_t predec, postdec_t postdec)
-        : any_iterator_ops<ValueType, std::forward_iterator_tag>(copy, move, assign,
-                                                                 destroy,
-                                                                 deref, preinc, postinc, eq)
+                               eq_t eq, next_batch_t next_batch,
+                               deref_inc_t deref_inc, next_t next, next_prefetched_t next_prefetched,
+                               predec_t predec, postdec_t postdec)
+        : any_iterator_ops<ValueType, std::forward_iterator_tag, Storage, Reference>(type,
+                                                                          copy, move, assign,
+                                                                          destroy, algorithms,
+                                                                          deref, preinc, postinc,
+                                                                          eq, next_batch,
+                                                                          deref_inc, next, next_prefetched)
         , predec(predec)
         , postdec(postdec)
     {}
 };
 
-template <typename ValueType>
-struct any_iterator_ops<ValueType, std::random_access_iterator_tag> : any_iterator_ops<ValueType, std::bidirectional_iterator_tag>
+template <typename ValueType, typename Storage, typename Reference>
+struct any_iterator_ops<ValueType, std::random_access_iterator_tag, Storage, Reference> : any_iterator_ops<ValueType, std::bidirectional_iterator_tag, Storage, Reference>
 {
-    typedef any_iterator_ops<ValueType, std::bidirectional_iterator_tag> base;
+    typedef any_iterator_ops<ValueType, std::bidirectional_iterator_tag, Storage, Reference> base;
     using typename base::copy_t;
     using typename base::move_t;
     using typename base::assign_t;
     using typename base::destroy_t;
+    using typename base::algorithms_t;
     using typename base::deref_t;
     using typename base::preinc_t;
     using typename base::postinc_t;
     using typename base::eq_t;
+    using typename base::next_batch_t;
+    using typename base::deref_inc_t;
+    using typename base::next_t;
+    using typename base::next_prefetched_t;
 
     using typename base::predec_t;
     using typename base::postdec_t;
 
-    using add_t = void (*)(small_storage_type& obj, size_t n);
-    using sub_t = void (*)(small_storage_type& obj, size_t n);
-    using diff_t = std::ptrdiff_t (*)(small_storage_type const& lhs, small_storage_type const& rhs);
-    using lt_t = bool (*)(small_storage_type const& lhs, small_storage_type const& rhs);
-    using subscript_t = ValueType& (*)(small_storage_type const& obj, std::ptrdiff_t n);
+    using add_t = void (*)(Storage& obj, size_t n);
+    using sub_t = void (*)(Storage& obj, size_t n);
+    using diff_t = std::ptrdiff_t (*)(Storage const& lhs, Storage const& rhs);
+    using lt_t = bool (*)(Storage const& lhs, Storage const& rhs);
+    using subscript_t = Reference (*)(Storage const& obj, std::ptrdiff_t n);
+    using contiguous_data_t = ValueType* (*)(Storage const& obj);
 
     add_t add;
     sub_t sub;
     diff_t diff;
     lt_t lt;
     subscript_t subscript;
+    // null if the inner iterator is not contiguous or Reference is not
+    // ValueType&
+    contiguous_data_t contiguous_data;
 
-    constexpr any_iterator_ops(copy_t copy, move_t move, assign_t assign,
-                               destroy_t destroy,
+    constexpr any_iterator_ops(std::type_info const* type,
+                               copy_t copy, move_t move, assign_t assign,
+                               destroy_t destroy, algorithms_t algorithms,
                                deref_t deref, preinc_t preinc, postinc_t postinc,
-                               eq_t eq, predec_t predec, postdec_t postdec,
+                               eq_t eq, next_batch_t next_batch,
+                               deref_inc_t deref_inc, next_t next, next_prefetched_t next_prefetched,
+                               predec_t predec, postdec_t postdec,
                                add_t add, sub_t sub, diff_t diff, lt_t lt,
-                               subscript_t subscript)
-        : any_iterator_ops<ValueType, std::bidirectional_iterator_tag>(copy, move, assign,
-                                                                       destroy,
-                                                                       deref, preinc, postinc,
-                                                                       eq, predec, postdec)
+                               subscript_t subscript, contiguous_data_t contiguous_data)
+        : any_iterator_ops<ValueType, std::bidirectional_iterator_tag, Storage, Reference>(type,
+                                                                                copy, move, assign,
+                                                                                destroy, algorithms,
+                                                                                deref, preinc, postinc,
+                                                                                eq, next_batch,
+                                                                                deref_inc, next, next_prefetched,
+                                                                                predec, postdec)
         , add(add)
         , sub(sub)
         , diff(diff)
         , lt(lt)
         , subscript(subscript)
+        , contiguous_data(contiguous_data)
     {}
 };
 
-void null_clone(small_storage_type&, small_storage_type const&)
-{}
-
-void null_move(small_storage_type&, small_storage_type&)
+template <typename Storage>
+void null_clone(Storage&, Storage const&)
 {}
 
-template <typename ValueType>
-void null_assign(any_iterator_ops<ValueType, std::forward_iterator_tag> const* dst_ops, small_storage_type& dst, small_storage_type const&)
+template <typename ValueType, typename Storage, typename Reference>
+void null_assign(any_iterator_ops<ValueType, std::forward_iterator_tag, Storage, Reference> const* dst_ops, Storage& dst, Storage const&)
 {
     dst_ops->destroy(dst);
 }
 
-void null_destroy(small_storage_type&)
+template <typename Storage>
+void null_destroy(Storage&)
 {}
 
-template <typename ValueType>
-ValueType& null_deref(small_storage_type const&)
+template <typename Reference, typename Storage>
+Reference null_deref(Storage const&)
 {
     throw bad_any_iterator();
 }
 
-void null_preinc(small_storage_type&)
+template <typename Storage>
+void null_preinc(Storage&)
 {
     throw bad_any_iterator();
 }
 
-void null_postinc(small_storage_type&, small_storage_type&)
+template <typename Storage>
+void null_postinc(Storage&, Storage&)
 {
     throw bad_any_iterator();
 }
 
-bool null_eq(small_storage_type const&, small_storage_type const&)
+template <typename Storage>
+bool null_eq(Storage const&, Storage const&)
 {
     throw bad_any_iterator();
 }
 
-void null_predec(small_storage_type&)
+template <typename ValueType, typename Storage>
+size_t null_next_batch(Storage&, Storage const&, ValueType**, size_t)
 {
     throw bad_any_iterator();
 }
 
-void null_postdec(small_storage_type&, small_storage_type&)
+template <typename Reference, typename Storage>
+Reference null_deref_inc(Storage&)
 {
     throw bad_any_iterator();
 }
 
-void null_add(small_storage_type&, size_t)
+template <typename ValueType, typename Storage>
+ValueType* null_next(Storage&, Storage const&)
 {
     throw bad_any_iterator();
 }
 
-void null_sub(small_storage_type&, size_t)
+template <typename Storage>
+void null_predec(Storage&)
 {
     throw bad_any_iterator();
 }
 
-std::ptrdiff_t null_diff(small_storage_type const&, small_storage_type const&)
+template <typename Storage>
+void null_postdec(Storage&, Storage&)
 {
     throw bad_any_iterator();
 }
 
-bool null_lt(small_storage_type const&, small_storage_type const&)
+template <typename Storage>
+void null_add(Storage&, size_t)
 {
     throw bad_any_iterator();
 }
 
-template <typename ValueType>
-ValueType& null_subscript(small_storage_type const&, std::ptrdiff_t)
+template <typename Storage>
+void null_sub(Storage&, size_t)
 {
     throw bad_any_iterator();
 }
 
-template <typename ValueType>
-inline any_iterator_ops<ValueType, std::random_access_iterator_tag> const* make_null_ops()
+template <typename Storage>
+std::ptrdiff_t null_diff(Storage const&, Storage const&)
 {
-    static constexpr any_iterator_ops<ValueType, std::random_access_iterator_tag> instance
-    (
-        &null_clone,
-        &null_move,
-        &null_assign,
-        &null_destroy,
-
-        &null_deref<ValueType>,
-        &null_preinc,
-        &null_postinc,
+    throw bad_any_iterator();
+}
 
-        &null_eq,
+template <typename Storage>
+bool null_lt(Storage const&, Storage const&)
+{
+    throw bad_any_iterator();
+}
 
-        &null_predec,
-        &null_postdec,
+template <typename Reference, typename Storage>
+Reference null_subscript(Storage const&, std::ptrdiff_t)
+{
+    throw bad_any_iterator();
+}
 
-        &null_add,
-        &null_sub,
-        &null_diff,
-        &null_lt,
-        &null_subscript<ValueType>
+template <typename ValueType, typename Storage, typename Reference = ValueType&>
+inline erased_ops<ValueType, std::random_access_iterator_tag, Storage, Reference> const* make_null_ops()
+{
+    using erased = erased_types<ValueType, Reference>;
+    if constexpr (!std::is_same<typename erased::value_type, ValueType>::value)
+        return make_null_ops<typename erased::value_type, Storage, typename erased::reference>();
+    else
+    {
+    alignas(cache_line_size) static constexpr any_iterator_ops<ValueType, std::random_access_iterator_tag, Storage, Reference> instance
+    (
+        &typeid(void),
+
+        &null_clone<Storage>,
+        nullptr,
+        &null_assign<ValueType, Storage, Reference>,
+        &null_destroy<Storage>,
+        nullptr,
+
+        &null_deref<Reference, Storage>,
+        &null_preinc<Storage>,
+        &null_postinc<Storage>,
+
+        &null_eq<Storage>,
+        &null_next_batch<ValueType, Storage>,
+        &null_deref_inc<Reference, Storage>,
+        &null_next<ValueType, Storage>,
+        nullptr,
+
+        &null_predec<Storage>,
+        &null_postdec<Storage>,
+
+        &null_add<Storage>,
+        &null_sub<Storage>,
+        &null_diff<Storage>,
+        &null_lt<Storage>,
+        &null_subscript<Reference, Storage>,
+        nullptr
     );
 
     return &instance;
+    }
 }
 
-template <typename InnerIterator>
-constexpr bool fits_small_storage
-    = sizeof(InnerIterator) <= small_storage_size
-   && alignof(InnerIterator) <= small_storage_alignment
-   && std::is_trivially_move_constructible<InnerIterator>::value;
+// Types whose objects can be moved to another address by copying their
+// bytes, without running the move constructor and destructor. Trivially
+// copyable types are, specialize this for other types that are too.
+template <typename T, typename = void>
+struct is_trivially_relocatable : std::is_trivially_copyable<T>
+{};
 
-template <typename InnerIterator>
-typename std::enable_if<fits_small_storage<InnerIterator>, InnerIterator&>::type access(small_storage_type& stg)
+template <typename T, typename = void>
+struct is_deque_iterator
 {
-    return reinterpret_cast<InnerIterator&>(stg);
-}
+    static constexpr bool value = false;
+};
 
 template <typename InnerIterator>
-typename std::enable_if<!fits_small_storage<InnerIterator>, InnerIterator&>::type access(small_storage_type& stg)
+struct is_deque_iterator<InnerIterator, std::void_t<typename std::iterator_traits<InnerIterator>::value_type> >
 {
-    return *reinterpret_cast<InnerIterator*&>(stg);
-}
+    using value_type = typename std::iterator_traits<InnerIterator>::value_type;
+    // output iterators have a void value_type, and no deque holds abstract
+    // classes
+    using deque = std::deque<typename std::conditional<std::is_object<value_type>::value && !std::is_abstract<value_type>::value,
+                                                       value_type, int>::type>;
+
+    static constexpr bool value = std::is_same<InnerIterator, typename deque::iterator>::value
+                               || std::is_same<InnerIterator, typename deque::const_iterator>::value;
+};
 
+// libstdc++'s deque iterators only hold pointers but declare their copy
+// constructors; elsewhere they are left to the trivially copyable check
+#if defined(__GLIBCXX__)
 template <typename InnerIterator>
-typename std::enable_if<fits_small_storage<InnerIterator>, InnerIterator const&>::type access(small_storage_type const& stg)
-{
-    return reinterpret_cast<InnerIterator const&>(stg);
-}
+struct is_trivially_relocatable<InnerIterator, typename std::enable_if<is_deque_iterator<InnerIterator>::value>::type> : std::true_type
+{};
+#endif
 
 template <typename InnerIterator>
-typename std::enable_if<!fits_small_storage<InnerIterator>, InnerIterator const&>::type access(small_storage_type const& stg)
-{
-    return *reinterpret_cast<InnerIterator* const&>(stg);
+struct is_trivially_relocatable<std::reverse_iterator<InnerIterator> > : is_trivially_relocatable<InnerIterator>
+{};
+
+template <typename T, typename CharT, typename Traits, typename Distance>
+struct is_trivially_relocatable<std::istream_iterator<T, CharT, Traits, Distance> > : is_trivially_relocatable<T>
+{};
+
+template <typename ValueType, typename Category, typename Storage, typename Reference>
+struct is_trivially_relocatable<any_iterator<ValueType, Category, Storage, Reference> >
+    : std::integral_constant<bool, Storage::trivially_relocatable>
+{};
+
+template <typename ValueType, typename Category, typename Storage, typename Reference>
+struct is_trivially_relocatable<any_range<ValueType, Category, Storage, Reference> >
+    : std::integral_constant<bool, Storage::trivially_relocatable>
+{};
+
+template <typename ValueType, typename Storage, typename Reference>
+struct is_trivially_relocatable<any_sentinel<ValueType, Storage, Reference> >
+    : std::integral_constant<bool, Storage::trivially_relocatable>
+{};
+
+// Moves [first, last) into the uninitialized memory at dst and ends the
+// lifetime of the source objects, like a move construction followed by a
+// destruction of each. Trivially relocatable types are moved with a single
+// memmove. dst may overlap the source if it precedes first.
+template <typename T>
+typename std::enable_if<is_trivially_relocatable<T>::value, T*>::type relocate(T* first, T* last, T* dst) noexcept
+{
+    size_t n = static_cast<size_t>(last - first);
+    if (n != 0)
+        std::memmove(static_cast<void*>(dst), static_cast<void const*>(first), n * sizeof(T));
+    return dst + n;
 }
 
-template <typename InnerIterator, typename InnerIteratorRef>
-typename std::enable_if<fits_small_storage<InnerIterator>>::type inner_construct(small_storage_type& dst, InnerIteratorRef&& it)
+template <typename T>
+typename std::enable_if<!is_trivially_relocatable<T>::value, T*>::type relocate(T* first, T* last, T* dst) noexcept(std::is_nothrow_move_constructible<T>::value)
 {
-    static_assert(std::is_same<typename std::decay<InnerIteratorRef>::type, InnerIterator>::value);
-
-    new (&dst) InnerIterator(std::forward<InnerIteratorRef>(it));
+    for (; first != last; ++first, ++dst)
+    {
+        new (dst) T(std::move(*first));
+        first->~T();
+    }
+    return dst;
 }
 
-template <typename InnerIterator, typename InnerIteratorRef>
-typename std::enable_if<!fits_small_storage<InnerIterator>>::type inner_construct(small_storage_type& dst, InnerIteratorRef&& it)
+// Inner iterators are kept inline if they fit and are nothrow movable, and
+// with a relocatable_storage only if they are trivially relocatable too.
+template <typename InnerIterator, typename Storage>
+constexpr bool fits_small_storage
+    = sizeof(InnerIterator) <= Storage::size
+   && alignof(InnerIterator) <= Storage::alignment
+   && std::is_nothrow_move_constructible<InnerIterator>::value
+   && (!Storage::trivially_relocatable || is_trivially_relocatable<InnerIterator>::value);
+
+// Heap inner iterators are owned by one any_iterator, or shared between
+// copies if the storage is a shared_storage.
+template <typename InnerIterator, typename Storage>
+constexpr bool shares_heap_storage
+    = !fits_small_storage<InnerIterator, Storage>
+   && !std::is_void<typename Storage::shared_counter>::value;
+
+template <typename InnerIterator, typename Storage>
+constexpr bool owns_heap_storage
+    = !fits_small_storage<InnerIterator, Storage>
+   && std::is_void<typename Storage::shared_counter>::value;
+
+template <typename InnerIterator, typename Storage>
+using inner_allocator = typename std::allocator_traits<typename Storage::allocator_type>::template rebind_alloc<InnerIterator>;
+
+template <typename InnerIterator, typename Storage>
+struct inner_deleter
+{
+    void operator()(InnerIterator* p) const noexcept
+    {
+        inner_allocator<InnerIterator, Storage> alloc;
+        std::allocator_traits<inner_allocator<InnerIterator, Storage> >::destroy(alloc, p);
+        std::allocator_traits<inner_allocator<InnerIterator, Storage> >::deallocate(alloc, p, 1);
+    }
+};
+
+template <typename InnerIterator, typename Storage>
+using inner_ptr = std::unique_ptr<InnerIterator, inner_deleter<InnerIterator, Storage> >;
+
+template <typename InnerIterator, typename Storage, typename... Args>
+inner_ptr<InnerIterator, Storage> make_inner(Args&&... args)
 {
-    static_assert(std::is_same<typename std::decay<InnerIteratorRef>::type, InnerIterator>::value);
+    using traits = std::allocator_traits<inner_allocator<InnerIterator, Storage> >;
 
-    new (&dst) InnerIterator*(new InnerIterator(std::forward<InnerIteratorRef>(it)));
+    inner_allocator<InnerIterator, Storage> alloc;
+    InnerIterator* p = traits::allocate(alloc, 1);
+    try
+    {
+        traits::construct(alloc, p, std::forward<Args>(args)...);
+    }
+    catch (...)
+    {
+        traits::deallocate(alloc, p, 1);
+        throw;
+    }
+    return inner_ptr<InnerIterator, Storage>(p);
 }
 
-template <typename InnerIterator>
-typename std::enable_if<fits_small_storage<InnerIterator>>::type inner_copy(small_storage_type& dst, small_storage_type const& src)
+template <typename InnerIterator, typename Counter>
+struct shared_block
 {
-    new (&dst) InnerIterator(access<InnerIterator>(src));
-}
+    template <typename... Args>
+    explicit shared_block(Args&&... args)
+        : it(std::forward<Args>(args)...)
+    {}
 
-template <typename InnerIterator>
-typename std::enable_if<!fits_small_storage<InnerIterator>>::type inner_copy(small_storage_type& dst, small_storage_type const& src)
+    Counter refs{1};
+    InnerIterator it;
+};
+
+template <typename InnerIterator, typename Storage>
+using shared_block_of = shared_block<InnerIterator, typename Storage::shared_counter>;
+
+template <typename InnerIterator, typename Storage>
+void release_shared(shared_block_of<InnerIterator, Storage>* b) noexcept
 {
-    new (&dst) InnerIterator*(new InnerIterator(access<InnerIterator>(src)));
+    if (--b->refs == 0)
+        inner_deleter<shared_block_of<InnerIterator, Storage>, Storage>()(b);
 }
 
-template <typename InnerIterator>
-typename std::enable_if<fits_small_storage<InnerIterator>>::type inner_move(small_storage_type& dst, small_storage_type& src)
+template <typename InnerIterator, typename Storage>
+typename std::enable_if<fits_small_storage<InnerIterator, Storage>, InnerIterator&>::type access(Storage& stg)
 {
-    new (&dst) InnerIterator(std::move(access<InnerIterator>(src)));
-    access<InnerIterator>(src).~InnerIterator();
+    return reinterpret_cast<InnerIterator&>(stg);
 }
 
-template <typename InnerIterator>
-typename std::enable_if<!fits_small_storage<InnerIterator>>::type inner_move(small_storage_type& dst, small_storage_type& src)
+template <typename InnerIterator, typename Storage>
+typename std::enable_if<owns_heap_storage<InnerIterator, Storage>, InnerIterator&>::type access(Storage& stg)
 {
-    reinterpret_cast<InnerIterator*&>(dst) = reinterpret_cast<InnerIterator*&>(src);
+    return *reinterpret_cast<InnerIterator*&>(stg);
 }
 
-template <typename ValueType, typename InnerIterator>
-typename std::enable_if<fits_small_storage<InnerIterator>>::type inner_assign(any_iterator_ops<ValueType, std::forward_iterator_tag> const* dst_ops, small_storage_type& dst, small_storage_type const& src)
+// a shared block is cloned before its inner iterator can be changed
+template <typename InnerIterator, typename Storage>
+typename std::enable_if<shares_heap_storage<InnerIterator, Storage>, InnerIterator&>::type access(Storage& stg)
 {
-    dst_ops->destroy(dst);
-    new (&dst) InnerIterator(access<InnerIterator>(src));
+    auto& b = reinterpret_cast<shared_block_of<InnerIterator, Storage>*&>(stg);
+    if (b->refs != 1)
+    {
+        ANY_ITERATOR_STATS_ALLOCATION(unshare);
+        auto p = make_inner<shared_block_of<InnerIterator, Storage>, Storage>(b->it);
+        release_shared<InnerIterator, Storage>(b);
+        b = p.release();
+    }
+    return b->it;
 }
 
-template <typename ValueType, typename InnerIterator>
-typename std::enable_if<!fits_small_storage<InnerIterator> >::type inner_assign(any_iterator_ops<ValueType, std::forward_iterator_tag> const* dst_ops, small_storage_type& dst, small_storage_type const& src)
+template <typename InnerIterator, typename Storage>
+typename std::enable_if<fits_small_storage<InnerIterator, Storage>, InnerIterator const&>::type access(Storage const& stg)
 {
-    auto p = std::make_unique<InnerIterator>(access<InnerIterator>(src));
-    dst_ops->destroy(dst);
-    new (&dst) InnerIterator*(p.release());
+    return reinterpret_cast<InnerIterator const&>(stg);
 }
 
-template <typename InnerIterator>
-typename std::enable_if<fits_small_storage<InnerIterator>>::type inner_destroy(small_storage_type& obj)
+template <typename InnerIterator, typename Storage>
+typename std::enable_if<owns_heap_storage<InnerIterator, Storage>, InnerIterator const&>::type access(Storage const& stg)
 {
-    access<InnerIterator>(obj).~InnerIterator();
+    return *reinterpret_cast<InnerIterator* const&>(stg);
 }
 
-template <typename InnerIterator>
-typename std::enable_if<!fits_small_storage<InnerIterator>>::type inner_destroy(small_storage_type& obj)
+template <typename InnerIterator, typename Storage>
+typename std::enable_if<shares_heap_storage<InnerIterator, Storage>, InnerIterator const&>::type access(Storage const& stg)
 {
-    delete &access<InnerIterator>(obj);
+    return reinterpret_cast<shared_block_of<InnerIterator, Storage>* const&>(stg)->it;
 }
 
-template <typename ValueType, typename InnerIterator>
-ValueType& inner_deref(small_storage_type const& obj)
+template <typename InnerIterator, typename Storage, typename InnerIteratorRef>
+typename std::enable_if<fits_small_storage<InnerIterator, Storage>>::type inner_construct(Storage& dst, InnerIteratorRef&& it)
+{
+    static_assert(std::is_same<typename std::decay<InnerIteratorRef>::type, InnerIterator>::value);
+
+    ANY_ITERATOR_STATS_CONSTRUCT(InnerIterator, false);
+    new (&dst) InnerIterator(std::forward<InnerIteratorRef>(it));
+}
+
+template <typename InnerIterator, typename Storage, typename InnerIteratorRef>
+typename std::enable_if<owns_heap_storage<InnerIterator, Storage>>::type inner_construct(Storage& dst, InnerIteratorRef&& it)
+{
+    static_assert(std::is_same<typename std::decay<InnerIteratorRef>::type, InnerIterator>::value);
+
+    ANY_ITERATOR_STATS_CONSTRUCT(InnerIterator, true);
+    ANY_ITERATOR_STATS_ALLOCATION(construct);
+    new (&dst) InnerIterator*(make_inner<InnerIterator, Storage>(std::forward<InnerIteratorRef>(it)).release());
+}
+
+template <typename InnerIterator, typename Storage, typename InnerIteratorRef>
+typename std::enable_if<shares_heap_storage<InnerIterator, Storage>>::type inner_construct(Storage& dst, InnerIteratorRef&& it)
+{
+    static_assert(std::is_same<typename std::decay<InnerIteratorRef>::type, InnerIterator>::value);
+
+    ANY_ITERATOR_STATS_CONSTRUCT(InnerIterator, true);
+    ANY_ITERATOR_STATS_ALLOCATION(construct);
+    using block = shared_block_of<InnerIterator, Storage>;
+    new (&dst) block*(make_inner<block, Storage>(std::forward<InnerIteratorRef>(it)).release());
+}
+
+template <typename InnerIterator, typename Storage>
+typename std::enable_if<fits_small_storage<InnerIterator, Storage>>::type inner_copy(Storage& dst, Storage const& src)
+{
+    new (&dst) InnerIterator(access<InnerIterator>(src));
+}
+
+template <typename InnerIterator, typename Storage>
+typename std::enable_if<owns_heap_storage<InnerIterator, Storage>>::type inner_copy(Storage& dst, Storage const& src)
+{
+    ANY_ITERATOR_STATS_ALLOCATION(copy);
+    new (&dst) InnerIterator*(make_inner<InnerIterator, Storage>(access<InnerIterator>(src)).release());
+}
+
+template <typename InnerIterator, typename Storage>
+typename std::enable_if<shares_heap_storage<InnerIterator, Storage>>::type inner_copy(Storage& dst, Storage const& src)
+{
+    auto b = reinterpret_cast<shared_block_of<InnerIterator, Storage>* const&>(src);
+    ++b->refs;
+    new (&dst) shared_block_of<InnerIterator, Storage>*(b);
+}
+
+template <typename InnerIterator, typename Storage>
+void inner_move(Storage& dst, Storage& src) noexcept
+{
+    new (&dst) InnerIterator(std::move(access<InnerIterator>(src)));
+    access<InnerIterator>(src).~InnerIterator();
+}
+
+// Heap inner iterators and trivially relocatable inline ones are moved by
+// copying the bytes of the storage, so only the others get a move entry.
+template <typename InnerIterator, typename Storage>
+constexpr bool needs_inner_move
+    = fits_small_storage<InnerIterator, Storage>
+   && !is_trivially_relocatable<InnerIterator>::value;
+
+template <typename InnerIterator, typename Storage>
+constexpr typename std::enable_if<needs_inner_move<InnerIterator, Storage>, void (*)(Storage&, Storage&)>::type make_inner_move()
+{
+    return &inner_move<InnerIterator, Storage>;
+}
+
+template <typename InnerIterator, typename Storage>
+constexpr typename std::enable_if<!needs_inner_move<InnerIterator, Storage>, void (*)(Storage&, Storage&)>::type make_inner_move()
+{
+    return nullptr;
+}
+
+// Moves the inner iterator of src to dst and ends its lifetime in src.
+template <typename Storage>
+void move_storage(void (*move)(Storage&, Storage&), Storage& dst, Storage& src) noexcept
+{
+    if (move)
+        move(dst, src);
+    else
+        dst = src;
+}
+
+template <typename ValueType, typename InnerIterator, typename Storage, typename Reference>
+typename std::enable_if<fits_small_storage<InnerIterator, Storage>>::type inner_assign(any_iterator_ops<ValueType, std::forward_iterator_tag, Storage, Reference> const* dst_ops, Storage& dst, Storage const& src)
+{
+    dst_ops->destroy(dst);
+    new (&dst) InnerIterator(access<InnerIterator>(src));
+}
+
+template <typename ValueType, typename InnerIterator, typename Storage, typename Reference>
+typename std::enable_if<owns_heap_storage<InnerIterator, Storage> >::type inner_assign(any_iterator_ops<ValueType, std::forward_iterator_tag, Storage, Reference> const* dst_ops, Storage& dst, Storage const& src)
+{
+    ANY_ITERATOR_STATS_ALLOCATION(assign);
+    auto p = make_inner<InnerIterator, Storage>(access<InnerIterator>(src));
+    dst_ops->destroy(dst);
+    new (&dst) InnerIterator*(p.release());
+}
+
+template <typename ValueType, typename InnerIterator, typename Storage, typename Reference>
+typename std::enable_if<shares_heap_storage<InnerIterator, Storage> >::type inner_assign(any_iterator_ops<ValueType, std::forward_iterator_tag, Storage, Reference> const* dst_ops, Storage& dst, Storage const& src)
+{
+    auto b = reinterpret_cast<shared_block_of<InnerIterator, Storage>* const&>(src);
+    ++b->refs;
+    dst_ops->destroy(dst);
+    new (&dst) shared_block_of<InnerIterator, Storage>*(b);
+}
+
+template <typename InnerIterator, typename Storage>
+typename std::enable_if<fits_small_storage<InnerIterator, Storage>>::type inner_destroy(Storage& obj)
+{
+    access<InnerIterator>(obj).~InnerIterator();
+}
+
+template <typename InnerIterator, typename Storage>
+typename std::enable_if<owns_heap_storage<InnerIterator, Storage>>::type inner_destroy(Storage& obj)
+{
+    inner_deleter<InnerIterator, Storage>()(&access<InnerIterator>(obj));
+}
+
+template <typename InnerIterator, typename Storage>
+typename std::enable_if<shares_heap_storage<InnerIterator, Storage>>::type inner_destroy(Storage& obj)
+{
+    release_shared<InnerIterator, Storage>(reinterpret_cast<shared_block_of<InnerIterator, Storage>*&>(obj));
+}
+
+// Tables are shared between ValueType and ValueType const (see
+// erased_types), so lvalue references to const elements are returned as
+// non-const, any_iterator<ValueType const> makes them const again.
+// Whether the elements of an iterator with reference InnerReference can be
+// returned as Reference. A Reference that is an lvalue reference has to
+// bind to the element itself, so the inner reference must be an lvalue
+// reference whose pointer converts, as for derived to base classes and T
+// to T const, and not a value converted into a temporary.
+template <typename InnerReference, typename Reference>
+struct is_reference_compatible
+    : std::integral_constant<bool,
+          std::is_convertible<InnerReference, Reference>::value
+       && (!std::is_lvalue_reference<Reference>::value
+        || (std::is_lvalue_reference<InnerReference>::value
+         && std::is_convertible<typename std::remove_reference<InnerReference>::type*,
+                                typename std::remove_reference<Reference>::type*>::value))>
+{};
+
+template <typename Reference, typename InnerReference>
+Reference erased_reference(InnerReference& value)
+{
+    return const_cast<Reference>(static_cast<typename std::remove_reference<Reference>::type const&>(value));
+}
+
+template <typename Reference, typename InnerIterator, typename Storage>
+typename std::enable_if<std::is_lvalue_reference<Reference>::value, Reference>::type inner_deref(Storage const& obj)
+{
+    return erased_reference<Reference>(*access<InnerIterator>(obj));
+}
+
+// other references are returned directly, by-value references are
+// constructed in the caller's return slot without intermediate moves
+template <typename Reference, typename InnerIterator, typename Storage>
+typename std::enable_if<!std::is_lvalue_reference<Reference>::value, Reference>::type inner_deref(Storage const& obj)
 {
     return *access<InnerIterator>(obj);
 }
 
-template <typename InnerIterator>
-void inner_preinc(small_storage_type& obj)
+template <typename InnerIterator, typename Storage>
+void inner_preinc(Storage& obj)
 {
     ++access<InnerIterator>(obj);
 }
 
-template <typename InnerIterator>
-typename std::enable_if<fits_small_storage<InnerIterator>>::type inner_postinc(small_storage_type& dst, small_storage_type& src)
+template <typename InnerIterator, typename Storage>
+typename std::enable_if<fits_small_storage<InnerIterator, Storage>>::type inner_postinc(Storage& dst, Storage& src)
 {
     new (&dst) InnerIterator(access<InnerIterator>(src));
     ++access<InnerIterator>(src);
 }
 
-template <typename InnerIterator>
-typename std::enable_if<!fits_small_storage<InnerIterator>>::type inner_postinc(small_storage_type& dst, small_storage_type& src)
+template <typename InnerIterator, typename Storage>
+typename std::enable_if<owns_heap_storage<InnerIterator, Storage>>::type inner_postinc(Storage& dst, Storage& src)
 {
-    auto p = std::make_unique<InnerIterator>(std::move(access<InnerIterator>(src)));
+    ANY_ITERATOR_STATS_ALLOCATION(postinc);
+    auto p = make_inner<InnerIterator, Storage>(std::move(access<InnerIterator>(src)));
     ++access<InnerIterator>(src);
     new (&dst) InnerIterator*(p.release());
 }
 
-template <typename InnerIterator>
-bool inner_eq(small_storage_type const& lhs, small_storage_type const& rhs)
+// dst takes over the reference to the old value, src moves to a new block
+template <typename InnerIterator, typename Storage>
+typename std::enable_if<shares_heap_storage<InnerIterator, Storage>>::type inner_postinc(Storage& dst, Storage& src)
+{
+    ANY_ITERATOR_STATS_ALLOCATION(postinc);
+    auto& b = reinterpret_cast<shared_block_of<InnerIterator, Storage>*&>(src);
+    auto p = make_inner<shared_block_of<InnerIterator, Storage>, Storage>(b->it);
+    ++p->it;
+    new (&dst) shared_block_of<InnerIterator, Storage>*(b);
+    b = p.release();
+}
+
+template <typename InnerIterator, typename Storage>
+bool inner_eq(Storage const& lhs, Storage const& rhs)
 {
     return access<InnerIterator>(lhs) == access<InnerIterator>(rhs);
 }
 
+template <typename ValueType, typename InnerIterator, typename Storage>
+size_t inner_next_batch(Storage& obj, Storage const& end, ValueType** out, size_t n)
+{
+    InnerIterator& it = access<InnerIterator>(obj);
+    InnerIterator const& last = access<InnerIterator>(end);
+
+    size_t i = 0;
+    for (; i != n && !(it == last); ++i, ++it)
+    {
+        ValueType& value = erased_reference<ValueType&>(*it);
+        out[i] = std::addressof(value);
+    }
+    return i;
+}
+
+template <typename ValueType, typename InnerIterator, typename Storage, typename Reference>
+constexpr typename std::enable_if<std::is_same<Reference, ValueType&>::value, size_t (*)(Storage&, Storage const&, ValueType**, size_t)>::type make_inner_next_batch()
+{
+    return &inner_next_batch<ValueType, InnerIterator, Storage>;
+}
+
+template <typename ValueType, typename InnerIterator, typename Storage, typename Reference>
+constexpr typename std::enable_if<!std::is_same<Reference, ValueType&>::value, size_t (*)(Storage&, Storage const&, ValueType**, size_t)>::type make_inner_next_batch()
+{
+    return nullptr;
+}
+
+template <typename Reference, typename InnerIterator, typename Storage>
+typename std::enable_if<std::is_lvalue_reference<Reference>::value, Reference>::type inner_deref_inc(Storage& obj)
+{
+    InnerIterator& it = access<InnerIterator>(obj);
+    Reference value = erased_reference<Reference>(*it);
+    ++it;
+    return value;
+}
+
+template <typename Reference, typename InnerIterator, typename Storage>
+typename std::enable_if<!std::is_lvalue_reference<Reference>::value, Reference>::type inner_deref_inc(Storage& obj)
+{
+    InnerIterator& it = access<InnerIterator>(obj);
+    Reference value = *it;
+    ++it;
+    return value;
+}
+
+template <typename ValueType, typename InnerIterator, typename Storage>
+ValueType* inner_next(Storage& obj, Storage const& end)
+{
+    InnerIterator& it = access<InnerIterator>(obj);
+    if (it == access<InnerIterator>(end))
+        return nullptr;
+
+    ValueType& value = erased_reference<ValueType&>(*it);
+    ++it;
+    return std::addressof(value);
+}
+
+template <typename ValueType, typename InnerIterator, typename Storage, typename Reference>
+constexpr typename std::enable_if<std::is_same<Reference, ValueType&>::value, ValueType* (*)(Storage&, Storage const&)>::type make_inner_next()
+{
+    return &inner_next<ValueType, InnerIterator, Storage>;
+}
+
+template <typename ValueType, typename InnerIterator, typename Storage, typename Reference>
+constexpr typename std::enable_if<!std::is_same<Reference, ValueType&>::value, ValueType* (*)(Storage&, Storage const&)>::type make_inner_next()
+{
+    return nullptr;
+}
+
+// Random access inner iterators walk memory the hardware prefetchers
+// follow, the others chase pointers through nodes that &*it points into.
 template <typename InnerIterator>
-void inner_predec(small_storage_type& obj)
+struct is_prefetchable
+{
+    static constexpr bool value = std::is_lvalue_reference<typename std::iterator_traits<InnerIterator>::reference>::value
+                               && !std::is_convertible<typename std::iterator_traits<InnerIterator>::iterator_category*,
+                                                       std::random_access_iterator_tag*>::value;
+};
+
+// The cursor steps onto the node it prefetched in the previous call and
+// prefetches the next one, which then loads while the caller works on the
+// element returned here.
+template <typename ValueType, typename InnerIterator, typename Storage>
+ValueType* inner_next_prefetched(Storage& obj, Storage& ahead, Storage const& end)
+{
+    InnerIterator& cursor = access<InnerIterator>(ahead);
+    InnerIterator const& last = access<InnerIterator>(end);
+    if (!(cursor == last) && !(++cursor == last))
+    {
+#if defined(__GNUC__)
+        __builtin_prefetch(std::addressof(*cursor));
+#endif
+    }
+    return inner_next<ValueType, InnerIterator, Storage>(obj, end);
+}
+
+template <typename ValueType, typename InnerIterator, typename Storage, typename Reference>
+constexpr typename std::enable_if<is_prefetchable<InnerIterator>::value && std::is_same<Reference, ValueType&>::value,
+                                  ValueType* (*)(Storage&, Storage&, Storage const&)>::type make_inner_next_prefetched()
+{
+    return &inner_next_prefetched<ValueType, InnerIterator, Storage>;
+}
+
+template <typename ValueType, typename InnerIterator, typename Storage, typename Reference>
+constexpr typename std::enable_if<!(is_prefetchable<InnerIterator>::value && std::is_same<Reference, ValueType&>::value),
+                                  ValueType* (*)(Storage&, Storage&, Storage const&)>::type make_inner_next_prefetched()
+{
+    return nullptr;
+}
+
+template <typename InnerIterator, typename Storage>
+void inner_predec(Storage& obj)
 {
     --access<InnerIterator>(obj);
 }
 
-template <typename InnerIterator>
-typename std::enable_if<fits_small_storage<InnerIterator>>::type inner_postdec(small_storage_type& dst, small_storage_type& src)
+template <typename InnerIterator, typename Storage>
+typename std::enable_if<fits_small_storage<InnerIterator, Storage>>::type inner_postdec(Storage& dst, Storage& src)
 {
     new (&dst) InnerIterator(access<InnerIterator>(src));
     --access<InnerIterator>(src);
 }
 
-template <typename InnerIterator>
-typename std::enable_if<!fits_small_storage<InnerIterator>>::type inner_postdec(small_storage_type& dst, small_storage_type& src)
+template <typename InnerIterator, typename Storage>
+typename std::enable_if<owns_heap_storage<InnerIterator, Storage>>::type inner_postdec(Storage& dst, Storage& src)
 {
-    auto p = std::make_unique<InnerIterator>(std::move(access<InnerIterator>(src)));
+    ANY_ITERATOR_STATS_ALLOCATION(postdec);
+    auto p = make_inner<InnerIterator, Storage>(std::move(access<InnerIterator>(src)));
     --access<InnerIterator>(src);
     new (&dst) InnerIterator*(p.release());
 }
 
-template <typename InnerIterator>
-void inner_add(small_storage_type& obj, size_t n)
+// dst takes over the reference to the old value, src moves to a new block
+template <typename InnerIterator, typename Storage>
+typename std::enable_if<shares_heap_storage<InnerIterator, Storage>>::type inner_postdec(Storage& dst, Storage& src)
+{
+    ANY_ITERATOR_STATS_ALLOCATION(postdec);
+    auto& b = reinterpret_cast<shared_block_of<InnerIterator, Storage>*&>(src);
+    auto p = make_inner<shared_block_of<InnerIterator, Storage>, Storage>(b->it);
+    --p->it;
+    new (&dst) shared_block_of<InnerIterator, Storage>*(b);
+    b = p.release();
+}
+
+template <typename InnerIterator, typename Storage>
+void inner_add(Storage& obj, size_t n)
 {
     access<InnerIterator>(obj) += n;
 }
 
-template <typename InnerIterator>
-void inner_sub(small_storage_type& obj, size_t n)
+template <typename InnerIterator, typename Storage>
+void inner_sub(Storage& obj, size_t n)
 {
     access<InnerIterator>(obj) -= n;
 }
 
-template <typename InnerIterator>
-std::ptrdiff_t inner_diff(small_storage_type const& lhs, small_storage_type const& rhs)
+template <typename InnerIterator, typename Storage>
+std::ptrdiff_t inner_diff(Storage const& lhs, Storage const& rhs)
 {
     return access<InnerIterator>(lhs) - access<InnerIterator>(rhs);
 }
 
-template <typename InnerIterator>
-bool inner_lt(small_storage_type const& lhs, small_storage_type const& rhs)
+template <typename InnerIterator, typename Storage>
+bool inner_lt(Storage const& lhs, Storage const& rhs)
 {
     return access<InnerIterator>(lhs) < access<InnerIterator>(rhs);
 }
 
-template <typename ValueType, typename InnerIterator>
-ValueType& inner_subscript(small_storage_type const& obj, std::ptrdiff_t n)
+template <typename Reference, typename InnerIterator, typename Storage>
+typename std::enable_if<std::is_lvalue_reference<Reference>::value, Reference>::type inner_subscript(Storage const& obj, std::ptrdiff_t n)
+{
+    return erased_reference<Reference>(access<InnerIterator>(obj)[n]);
+}
+
+template <typename Reference, typename InnerIterator, typename Storage>
+typename std::enable_if<!std::is_lvalue_reference<Reference>::value, Reference>::type inner_subscript(Storage const& obj, std::ptrdiff_t n)
 {
     return access<InnerIterator>(obj)[n];
 }
 
-template <typename ValueType, typename InnerIterator, typename IteratorCategory>
-struct iterator_ops_impl;
+// Contiguous iterators expose their elements as a raw array. Pointers and
+// std::vector iterators are detected automatically (any contiguous iterator
+// in C++20), other iterators can opt in by specializing this trait.
+template <typename InnerIterator, typename = void>
+struct is_contiguous_iterator
+{
+    static constexpr bool value = std::is_pointer<InnerIterator>::value;
+};
+
+#if defined(__cpp_lib_concepts)
+template <typename InnerIterator>
+struct is_contiguous_iterator<InnerIterator, typename std::enable_if<std::contiguous_iterator<InnerIterator> >::type>
+{
+    static constexpr bool value = true;
+};
+#else
+template <typename InnerIterator>
+struct is_vector_iterator
+{
+    using value_type = typename std::iterator_traits<InnerIterator>::value_type;
+    // output iterators have a void value_type
+    using vector = std::vector<typename std::conditional<std::is_void<value_type>::value, int, value_type>::type>;
+
+    static constexpr bool value = !std::is_same<value_type, bool>::value
+                               && (std::is_same<InnerIterator, typename vector::iterator>::value
+                                || std::is_same<InnerIterator, typename vector::const_iterator>::value);
+};
+
+template <typename InnerIterator>
+struct is_contiguous_iterator<InnerIterator, typename std::enable_if<is_vector_iterator<InnerIterator>::value>::type>
+{
+    static constexpr bool value = true;
+};
+#endif
 
+// contiguous_data is only provided when the elements of the inner iterator
+// are laid out exactly as an array of ValueType
 template <typename ValueType, typename InnerIterator>
-struct iterator_ops_impl<ValueType, InnerIterator, std::forward_iterator_tag>
+constexpr bool has_contiguous_data
+    = is_contiguous_iterator<InnerIterator>::value
+   && std::is_same<typename std::remove_cv<ValueType>::type,
+                   typename std::remove_cv<typename std::iterator_traits<InnerIterator>::value_type>::type>::value;
+
+template <typename InnerIterator>
+typename std::enable_if<std::is_pointer<InnerIterator>::value, InnerIterator>::type inner_to_address(InnerIterator it)
+{
+    return it;
+}
+
+template <typename InnerIterator>
+typename std::enable_if<!std::is_pointer<InnerIterator>::value, typename std::iterator_traits<InnerIterator>::pointer>::type inner_to_address(InnerIterator const& it)
+{
+#if defined(__cpp_lib_to_address)
+    return std::to_address(it);
+#else
+    return it.operator->();
+#endif
+}
+
+template <typename ValueType, typename InnerIterator, typename Storage>
+ValueType* inner_contiguous_data(Storage const& obj)
+{
+    return const_cast<ValueType*>(static_cast<ValueType const*>(inner_to_address(access<InnerIterator>(obj))));
+}
+
+template <typename ValueType, typename InnerIterator, typename Storage, typename Reference>
+constexpr typename std::enable_if<has_contiguous_data<ValueType, InnerIterator> && std::is_same<Reference, ValueType&>::value, ValueType* (*)(Storage const&)>::type make_inner_contiguous_data()
+{
+    return &inner_contiguous_data<ValueType, InnerIterator, Storage>;
+}
+
+template <typename ValueType, typename InnerIterator, typename Storage, typename Reference>
+constexpr typename std::enable_if<!(has_contiguous_data<ValueType, InnerIterator> && std::is_same<Reference, ValueType&>::value), ValueType* (*)(Storage const&)>::type make_inner_contiguous_data()
+{
+    return nullptr;
+}
+
+// the operators of the elements that the algorithm kernels need
+template <typename InnerIterator, typename ValueType, typename = void>
+struct has_inner_equal : std::false_type
+{};
+
+template <typename InnerIterator, typename ValueType>
+struct has_inner_equal<InnerIterator, ValueType, std::void_t<
+    decltype(bool(*std::declval<InnerIterator const&>() == std::declval<ValueType const&>())),
+    decltype(bool(*std::declval<InnerIterator const&>() == *std::declval<InnerIterator const&>()))> > : std::true_type
+{};
+
+template <typename InnerIterator, typename ValueType, typename = void>
+struct has_inner_less : std::false_type
+{};
+
+template <typename InnerIterator, typename ValueType>
+struct has_inner_less<InnerIterator, ValueType, std::void_t<
+    decltype(bool(*std::declval<InnerIterator const&>() < std::declval<ValueType const&>()))> > : std::true_type
+{};
+
+template <typename InnerIterator, typename ValueType, typename = void>
+struct has_inner_plus : std::false_type
+{};
+
+template <typename InnerIterator, typename ValueType>
+struct has_inner_plus<InnerIterator, ValueType, std::void_t<
+    decltype(std::declval<ValueType&>() = std::declval<ValueType>() + *std::declval<InnerIterator const&>())> > : std::true_type
+{};
+
+template <typename InnerIterator, typename ValueType, typename = void>
+struct has_inner_copy : std::false_type
+{};
+
+template <typename InnerIterator, typename ValueType>
+struct has_inner_copy<InnerIterator, ValueType, std::void_t<
+    decltype(std::declval<ValueType&>() = *std::declval<InnerIterator const&>())> > : std::true_type
+{};
+
+// Elements of a class derived from ValueType are seen as ValueType through
+// the erased references. The kernels would compare and add them with the
+// derived class' own operators instead, so there are none for them.
+template <typename InnerIterator, typename ValueType>
+constexpr bool erases_derived_elements
+    = !std::is_same<typename std::remove_cv<typename std::iterator_traits<InnerIterator>::value_type>::type, ValueType>::value
+   && std::is_base_of<ValueType, typename std::iterator_traits<InnerIterator>::value_type>::value;
+
+template <typename ValueType, typename InnerIterator, typename Storage>
+void inner_find(Storage& first, Storage const& last, ValueType const& value)
+{
+    InnerIterator& it = access<InnerIterator>(first);
+    it = std::find(it, access<InnerIterator>(last), value);
+}
+
+template <typename ValueType, typename InnerIterator, typename Storage>
+std::ptrdiff_t inner_count(Storage const& first, Storage const& last, ValueType const& value)
+{
+    return std::count(access<InnerIterator>(first), access<InnerIterator>(last), value);
+}
+
+template <typename ValueType, typename InnerIterator, typename Storage>
+void inner_accumulate(Storage const& first, Storage const& last, ValueType& acc)
+{
+    acc = std::accumulate(access<InnerIterator>(first), access<InnerIterator>(last), std::move(acc));
+}
+
+template <typename ValueType, typename InnerIterator, typename Storage>
+ValueType* inner_copy_to(Storage const& first, Storage const& last, ValueType* out)
+{
+    return std::copy(access<InnerIterator>(first), access<InnerIterator>(last), out);
+}
+
+template <typename InnerIterator, typename Storage>
+bool inner_equal(Storage const& first1, Storage const& last1, Storage const& first2)
+{
+    return std::equal(access<InnerIterator>(first1), access<InnerIterator>(last1), access<InnerIterator>(first2));
+}
+
+template <typename ValueType, typename InnerIterator, typename Storage>
+void inner_lower_bound(Storage& first, Storage const& last, ValueType const& value)
+{
+    InnerIterator& it = access<InnerIterator>(first);
+    it = std::lower_bound(it, access<InnerIterator>(last), value);
+}
+
+template <typename ValueType, typename InnerIterator, typename Storage>
+constexpr any_iterator_algorithms<ValueType, Storage> make_inner_algorithms()
+{
+    using algorithms = any_iterator_algorithms<ValueType, Storage>;
+    using value_type = typename algorithms::value_type;
+
+    // find and lower_bound assign the result to first
+    constexpr bool assignable = std::is_move_assignable<InnerIterator>::value;
+    constexpr bool own_elements = !erases_derived_elements<InnerIterator, value_type>;
+
+    typename algorithms::find_t find = nullptr;
+    typename algorithms::count_t count = nullptr;
+    typename algorithms::equal_t equal = nullptr;
+    if constexpr (own_elements && has_inner_equal<InnerIterator, value_type>::value)
+    {
+        if constexpr (assignable)
+            find = &inner_find<value_type, InnerIterator, Storage>;
+        count = &inner_count<value_type, InnerIterator, Storage>;
+        equal = &inner_equal<InnerIterator, Storage>;
+    }
+
+    typename algorithms::accumulate_t accumulate = nullptr;
+    if constexpr (own_elements && has_inner_plus<InnerIterator, value_type>::value)
+        accumulate = &inner_accumulate<value_type, InnerIterator, Storage>;
+
+    typename algorithms::copy_t copy = nullptr;
+    if constexpr (own_elements && has_inner_copy<InnerIterator, value_type>::value)
+        copy = &inner_copy_to<value_type, InnerIterator, Storage>;
+
+    typename algorithms::lower_bound_t lower_bound = nullptr;
+    if constexpr (own_elements && has_inner_less<InnerIterator, value_type>::value && assignable)
+        lower_bound = &inner_lower_bound<value_type, InnerIterator, Storage>;
+
+    return algorithms(find, count, accumulate, copy, equal, lower_bound);
+}
+
+// Kept apart from the ops table so that the kernels are only instantiated
+// along with a table that points to them.
+template <typename ValueType, typename InnerIterator, typename Storage>
+struct inner_algorithms
+{
+    static constexpr any_iterator_algorithms<ValueType, Storage> instance
+        = make_inner_algorithms<ValueType, InnerIterator, Storage>();
+};
+
+template <typename ValueType, typename InnerIterator, typename Storage, typename Reference, typename IteratorCategory>
+struct iterator_ops_impl;
+
+template <typename ValueType, typename InnerIterator, typename Storage, typename Reference>
+struct iterator_ops_impl<ValueType, InnerIterator, Storage, Reference, std::forward_iterator_tag>
 {
-    static constexpr any_iterator_ops<ValueType, std::forward_iterator_tag> make()
+    static constexpr any_iterator_ops<ValueType, std::forward_iterator_tag, Storage, Reference> make()
     {
         return
         {
-            &inner_copy<InnerIterator>,
-            &inner_move<InnerIterator>,
-            &inner_assign<ValueType, InnerIterator>,
-            &inner_destroy<InnerIterator>,
-            &inner_deref<ValueType, InnerIterator>,
-            &inner_preinc<InnerIterator>,
-            &inner_postinc<InnerIterator>,
-            &inner_eq<InnerIterator>
+            &typeid(InnerIterator),
+            &inner_copy<InnerIterator, Storage>,
+            make_inner_move<InnerIterator, Storage>(),
+            &inner_assign<ValueType, InnerIterator, Storage, Reference>,
+            &inner_destroy<InnerIterator, Storage>,
+            &inner_algorithms<ValueType, InnerIterator, Storage>::instance,
+            &inner_deref<Reference, InnerIterator, Storage>,
+            &inner_preinc<InnerIterator, Storage>,
+            &inner_postinc<InnerIterator, Storage>,
+            &inner_eq<InnerIterator, Storage>,
+            make_inner_next_batch<ValueType, InnerIterator, Storage, Reference>(),
+            &inner_deref_inc<Reference, InnerIterator, Storage>,
+            make_inner_next<ValueType, InnerIterator, Storage, Reference>(),
+            make_inner_next_prefetched<ValueType, InnerIterator, Storage, Reference>()
         };
     }
 };
 
-template <typename ValueType, typename InnerIterator>
-struct iterator_ops_impl<ValueType, InnerIterator, std::bidirectional_iterator_tag>
+template <typename ValueType, typename InnerIterator, typename Storage, typename Reference>
+struct iterator_ops_impl<ValueType, InnerIterator, Storage, Reference, std::bidirectional_iterator_tag>
 {
-    static constexpr any_iterator_ops<ValueType, std::bidirectional_iterator_tag> make()
+    static constexpr any_iterator_ops<ValueType, std::bidirectional_iterator_tag, Storage, Reference> make()
     {
         return
         {
-            &inner_copy<InnerIterator>,
-            &inner_move<InnerIterator>,
-            &inner_assign<ValueType, InnerIterator>,
-            &inner_destroy<InnerIterator>,
-            &inner_deref<ValueType, InnerIterator>,
-            &inner_preinc<InnerIterator>,
-            &inner_postinc<InnerIterator>,
-            &inner_eq<InnerIterator>,
-            &inner_predec<InnerIterator>,
-            &inner_postdec<InnerIterator>
+            &typeid(InnerIterator),
+            &inner_copy<InnerIterator, Storage>,
+            make_inner_move<InnerIterator, Storage>(),
+            &inner_assign<ValueType, InnerIterator, Storage, Reference>,
+            &inner_destroy<InnerIterator, Storage>,
+            &inner_algorithms<ValueType, InnerIterator, Storage>::instance,
+            &inner_deref<Reference, InnerIterator, Storage>,
+            &inner_preinc<InnerIterator, Storage>,
+            &inner_postinc<InnerIterator, Storage>,
+            &inner_eq<InnerIterator, Storage>,
+            make_inner_next_batch<ValueType, InnerIterator, Storage, Reference>(),
+            &inner_deref_inc<Reference, InnerIterator, Storage>,
+            make_inner_next<ValueType, InnerIterator, Storage, Reference>(),
+            make_inner_next_prefetched<ValueType, InnerIterator, Storage, Reference>(),
+            &inner_predec<InnerIterator, Storage>,
+            &inner_postdec<InnerIterator, Storage>
         };
     }
 };
 
-template <typename ValueType, typename InnerIterator>
-struct iterator_ops_impl<ValueType, InnerIterator, std::random_access_iterator_tag>
+template <typename ValueType, typename InnerIterator, typename Storage, typename Reference>
+struct iterator_ops_impl<ValueType, InnerIterator, Storage, Reference, std::random_access_iterator_tag>
 {
-    static constexpr any_iterator_ops<ValueType, std::random_access_iterator_tag> make()
+    static constexpr any_iterator_ops<ValueType, std::random_access_iterator_tag, Storage, Reference> make()
     {
         return
         {
-            &inner_copy<InnerIterator>,
-            &inner_move<InnerIterator>,
-            &inner_assign<ValueType, InnerIterator>,
-            &inner_destroy<InnerIterator>,
-            &inner_deref<ValueType, InnerIterator>,
-            &inner_preinc<InnerIterator>,
-            &inner_postinc<InnerIterator>,
-            &inner_eq<InnerIterator>,
-            &inner_predec<InnerIterator>,
-            &inner_postdec<InnerIterator>,
-            &inner_add<InnerIterator>,
-            &inner_sub<InnerIterator>,
-            &inner_diff<InnerIterator>,
-            &inner_lt<InnerIterator>,
-            &inner_subscript<ValueType, InnerIterator>,
+            &typeid(InnerIterator),
+            &inner_copy<InnerIterator, Storage>,
+            make_inner_move<InnerIterator, Storage>(),
+            &inner_assign<ValueType, InnerIterator, Storage, Reference>,
+            &inner_destroy<InnerIterator, Storage>,
+            &inner_algorithms<ValueType, InnerIterator, Storage>::instance,
+            &inner_deref<Reference, InnerIterator, Storage>,
+            &inner_preinc<InnerIterator, Storage>,
+            &inner_postinc<InnerIterator, Storage>,
+            &inner_eq<InnerIterator, Storage>,
+            make_inner_next_batch<ValueType, InnerIterator, Storage, Reference>(),
+            &inner_deref_inc<Reference, InnerIterator, Storage>,
+            make_inner_next<ValueType, InnerIterator, Storage, Reference>(),
+            make_inner_next_prefetched<ValueType, InnerIterator, Storage, Reference>(),
+            &inner_predec<InnerIterator, Storage>,
+            &inner_postdec<InnerIterator, Storage>,
+            &inner_add<InnerIterator, Storage>,
+            &inner_sub<InnerIterator, Storage>,
+            &inner_diff<InnerIterator, Storage>,
+            &inner_lt<InnerIterator, Storage>,
+            &inner_subscript<Reference, InnerIterator, Storage>,
+            make_inner_contiguous_data<ValueType, InnerIterator, Storage, Reference>()
         };
     }
 };
 
-template <typename ValueType, typename InnerIterator>
-any_iterator_ops<ValueType, typename std::iterator_traits<InnerIterator>::iterator_category> const* make_inner_iterator_ops()
+template <typename ValueType, typename InnerIterator, typename Storage, typename Reference = ValueType&>
+erased_ops<ValueType, typename std::iterator_traits<InnerIterator>::iterator_category, Storage, Reference> const* make_inner_iterator_ops()
 {
-    static constexpr any_iterator_ops<ValueType, typename std::iterator_traits<InnerIterator>::iterator_category> instance
-        = iterator_ops_impl<ValueType, InnerIterator, typename std::iterator_traits<InnerIterator>::iterator_category>::make();
+    using erased = erased_types<ValueType, Reference>;
+    if constexpr (!std::is_same<typename erased::value_type, ValueType>::value)
+        return make_inner_iterator_ops<typename erased::value_type, InnerIterator, Storage, typename erased::reference>();
+    else
+    {
+        alignas(cache_line_size) static constexpr any_iterator_ops<ValueType, typename std::iterator_traits<InnerIterator>::iterator_category, Storage, Reference> instance
+            = iterator_ops_impl<ValueType, InnerIterator, Storage, Reference, typename std::iterator_traits<InnerIterator>::iterator_category>::make();
 
-    return &instance;
+        return &instance;
+    }
 }
 
-template <typename ValueType, typename InnerIterator>
-any_iterator_ops<ValueType, typename std::iterator_traits<InnerIterator>::iterator_category> const* make_big_iterator_ops();
-
-template <typename ValueType, typename Category>
-ValueType& operator*(any_iterator<ValueType, Category> const& it);
+template <typename ValueType, typename Category, typename Storage, typename Reference>
+Reference operator*(any_iterator<ValueType, Category, Storage, Reference> const& it);
 
-template <typename ValueType, typename Category>
-any_iterator<ValueType, Category>& operator++(any_iterator<ValueType, Category>& it);
+template <typename ValueType, typename Category, typename Storage, typename Reference>
+any_iterator<ValueType, Category, Storage, Reference>& operator++(any_iterator<ValueType, Category, Storage, Reference>& it);
 
-template <typename ValueType, typename Category>
-any_iterator<ValueType, Category> operator++(any_iterator<ValueType, Category>& it, int);
+template <typename ValueType, typename Category, typename Storage, typename Reference>
+any_iterator<ValueType, Category, Storage, Reference> operator++(any_iterator<ValueType, Category, Storage, Reference>& it, int);
 
-template <typename ValueType, typename Category>
-bool operator==(any_iterator<ValueType, Category> const& lhs, any_iterator<ValueType, Category> const& rhs);
+template <typename ValueType, typename Category, typename Storage, typename Reference>
+bool operator==(any_iterator<ValueType, Category, Storage, Reference> const& lhs, any_iterator<ValueType, Category, Storage, Reference> const& rhs);
 
-template <typename ValueType, typename Category>
+template <typename ValueType, typename Category, typename Storage, typename Reference>
 typename std::enable_if<
     std::is_convertible<Category*, std::bidirectional_iterator_tag*>::value,
-    any_iterator<ValueType, Category>&
->::type operator--(any_iterator<ValueType, Category>& it);
+    any_iterator<ValueType, Category, Storage, Reference>&
+>::type operator--(any_iterator<ValueType, Category, Storage, Reference>& it);
 
-template <typename ValueType, typename Category>
+template <typename ValueType, typename Category, typename Storage, typename Reference>
 typename std::enable_if<
     std::is_convertible<Category*, std::bidirectional_iterator_tag*>::value,
-    any_iterator<ValueType, Category>
->::type operator--(any_iterator<ValueType, Category>& it, int);
+    any_iterator<ValueType, Category, Storage, Reference>
+>::type operator--(any_iterator<ValueType, Category, Storage, Reference>& it, int);
 
-template <typename ValueType, typename Category>
+template <typename ValueType, typename Category, typename Storage, typename Reference>
 typename std::enable_if<
     std::is_convertible<Category*, std::random_access_iterator_tag*>::value,
-    any_iterator<ValueType, Category>&
->::type operator+=(any_iterator<ValueType, Category>& it, std::size_t);
+    any_iterator<ValueType, Category, Storage, Reference>&
+>::type operator+=(any_iterator<ValueType, Category, Storage, Reference>& it, std::size_t);
 
-template <typename ValueType, typename Category>
+template <typename ValueType, typename Category, typename Storage, typename Reference>
 typename std::enable_if<
     std::is_convertible<Category*, std::random_access_iterator_tag*>::value,
-    any_iterator<ValueType, Category>&
->::type operator-=(any_iterator<ValueType, Category>& it, std::size_t);
+    any_iterator<ValueType, Category, Storage, Reference>&
+>::type operator-=(any_iterator<ValueType, Category, Storage, Reference>& it, std::size_t);
 
-template <typename ValueType, typename Category>
+template <typename ValueType, typename Category, typename Storage, typename Reference>
 typename std::enable_if<
     std::is_convertible<Category*, std::random_access_iterator_tag*>::value,
     std::ptrdiff_t
->::type operator-(any_iterator<ValueType, Category> const&, any_iterator<ValueType, Category> const&);
+>::type operator-(any_iterator<ValueType, Category, Storage, Reference> const&, any_iterator<ValueType, Category, Storage, Reference> const&);
 
-template <typename ValueType, typename Category>
+template <typename ValueType, typename Category, typename Storage, typename Reference>
 typename std::enable_if<
     std::is_convertible<Category*, std::random_access_iterator_tag*>::value,
     bool
->::type operator<(any_iterator<ValueType, Category> const&, any_iterator<ValueType, Category> const&);
+>::type operator<(any_iterator<ValueType, Category, Storage, Reference> const&, any_iterator<ValueType, Category, Storage, Reference> const&);
 
-template <typename ValueType, typename Category>
-struct any_iterator_base;
+template <typename... InnerIterators>
+struct any_iterator_visitor;
 
-template <typename ValueType>
-struct any_iterator_base<ValueType, std::forward_iterator_tag>
+template <>
+struct any_iterator_visitor<>
 {
+    template <typename AnyIterator, typename F>
+    static decltype(auto) apply(AnyIterator& it, F& f)
+    {
+        return f(it);
+    }
 };
 
-template <typename ValueType>
-struct any_iterator_base<ValueType, std::bidirectional_iterator_tag>
+template <typename InnerIterator, typename... InnerIterators>
+struct any_iterator_visitor<InnerIterator, InnerIterators...>
 {
-    any_iterator_ops<ValueType, std::bidirectional_iterator_tag> const*& get_ops()
+    template <typename AnyIterator, typename F>
+    static decltype(auto) apply(AnyIterator& it, F& f)
     {
-        return static_cast<any_iterator<ValueType, std::bidirectional_iterator_tag>&>(*this).ops;
+        if (auto inner = it.template target<InnerIterator>())
+            return f(*inner);
+        return any_iterator_visitor<InnerIterators...>::apply(it, f);
     }
+};
+
+// Source of the hot ops table entries of an any_iterator: the shared table
+// itself, or copies kept in the iterator if the storage asks for it.
+template <typename ValueType, typename Storage, typename Reference, bool = Storage::inline_hot_ops>
+struct any_iterator_hot_ops
+{
+    using ops_type = erased_ops<ValueType, std::forward_iterator_tag, Storage, Reference>;
+
+    void set_hot_ops(ops_type const*) noexcept
+    {}
 
-    any_iterator_ops<ValueType, std::bidirectional_iterator_tag> const* const& get_ops() const
+    static typename ops_type::deref_t hot_deref(ops_type const* ops) noexcept
     {
-        return static_cast<any_iterator<ValueType, std::bidirectional_iterator_tag> const&>(*this).ops;
+        return ops->deref;
     }
 
-    small_storage_type& get_stg()
+    static typename ops_type::preinc_t hot_preinc(ops_type const* ops) noexcept
     {
-        return static_cast<any_iterator<ValueType, std::bidirectional_iterator_tag>&>(*this).stg;
+        return ops->preinc;
     }
 
-    small_storage_type const& get_stg() const
+    static typename ops_type::eq_t hot_eq(ops_type const* ops) noexcept
     {
-        return static_cast<any_iterator<ValueType, std::bidirectional_iterator_tag> const&>(*this).stg;
+        return ops->eq;
     }
-
-    friend typename std::enable_if<
-        true,
-        any_iterator<ValueType, std::bidirectional_iterator_tag>&
-    >::type operator--<>(any_iterator<ValueType, std::bidirectional_iterator_tag>&);
-
-    friend typename std::enable_if<
-        true,
-        any_iterator<ValueType, std::bidirectional_iterator_tag>
-    >::type operator--<>(any_iterator<ValueType, std::bidirectional_iterator_tag>&, int);
 };
 
-template <typename ValueType>
-struct any_iterator_base<ValueType, std::random_access_iterator_tag>
+template <typename ValueType, typename Storage, typename Reference>
+struct any_iterator_hot_ops<ValueType, Storage, Reference, true>
 {
-    ValueType& operator[](std::ptrdiff_t n) const
-    {
-        return get_ops()->subscript(get_stg(), n);
-    }
+    using ops_type = erased_ops<ValueType, std::forward_iterator_tag, Storage, Reference>;
 
-    any_iterator_ops<ValueType, std::random_access_iterator_tag> const*& get_ops()
+    void set_hot_ops(ops_type const* ops) noexcept
     {
-        return static_cast<any_iterator<ValueType, std::random_access_iterator_tag>&>(*this).ops;
+        deref = ops->deref;
+        preinc = ops->preinc;
+        eq = ops->eq;
     }
 
-    any_iterator_ops<ValueType, std::random_access_iterator_tag> const* const& get_ops() const
+    typename ops_type::deref_t hot_deref(ops_type const*) const noexcept
     {
-        return static_cast<any_iterator<ValueType, std::random_access_iterator_tag> const&>(*this).ops;
+        return deref;
     }
 
-    small_storage_type& get_stg()
+    typename ops_type::preinc_t hot_preinc(ops_type const*) const noexcept
     {
-        return static_cast<any_iterator<ValueType, std::random_access_iterator_tag>&>(*this).stg;
+        return preinc;
     }
 
-    small_storage_type const& get_stg() const
+    typename ops_type::eq_t hot_eq(ops_type const*) const noexcept
     {
-        return static_cast<any_iterator<ValueType, std::random_access_iterator_tag> const&>(*this).stg;
+        return eq;
     }
 
-    friend typename std::enable_if<
-        true,
-        any_iterator<ValueType, std::random_access_iterator_tag>&
-    >::type operator+=<>(any_iterator<ValueType, std::random_access_iterator_tag>& it, std::size_t);
-
-    friend typename std::enable_if<
-        true,
-        any_iterator<ValueType, std::random_access_iterator_tag>&
-    >::type operator-=<>(any_iterator<ValueType, std::random_access_iterator_tag>& it, std::size_t);
+private:
+    typename ops_type::deref_t deref;
+    typename ops_type::preinc_t preinc;
+    typename ops_type::eq_t eq;
+};
 
-    friend typename std::enable_if<
-        true,
-        std::ptrdiff_t
-    >::type operator-<>(any_iterator<ValueType, std::random_access_iterator_tag> const&, any_iterator<ValueType, std::random_access_iterator_tag> const&);
+template <typename ValueType, typename Category, typename Storage, typename Reference>
+struct any_iterator_base;
 
-    friend typename std::enable_if<
-        true,
-        bool
-    >::type operator< <>(any_iterator<ValueType, std::random_access_iterator_tag> const&, any_iterator<ValueType, std::random_access_iterator_tag> const&);
+template <typename ValueType, typename Storage, typename Reference>
+struct any_iterator_base<ValueType, std::forward_iterator_tag, Storage, Reference>
+{
 };
 
-template <typename ValueType, typename Category>
-struct any_iterator : any_iterator_base<ValueType, Category>
+template <typename ValueType, typename Storage, typename Reference>
+struct any_iterator_base<ValueType, std::bidirectional_iterator_tag, Storage, Reference>
+{
+    void assign_ops(erased_ops<ValueType, std::bidirectional_iterator_tag, Storage, Reference> const* ops) noexcept
+    {
+        static_cast<any_iterator<ValueType, std::bidirectional_iterator_tag, Storage, Reference>&>(*this).set_ops(ops);
+    }
+
+    erased_ops<ValueType, std::bidirectional_iterator_tag, Storage, Reference> const* const& get_ops() const
+    {
+        return static_cast<any_iterator<ValueType, std::bidirectional_iterator_tag, Storage, Reference> const&>(*this).ops;
+    }
+
+    Storage& get_stg()
+    {
+        return static_cast<any_iterator<ValueType, std::bidirectional_iterator_tag, Storage, Reference>&>(*this).stg;
+    }
+
+    Storage const& get_stg() const
+    {
+        return static_cast<any_iterator<ValueType, std::bidirectional_iterator_tag, Storage, Reference> const&>(*this).stg;
+    }
+
+    friend typename std::enable_if<
+        true,
+        any_iterator<ValueType, std::bidirectional_iterator_tag, Storage, Reference>&
+    >::type operator--<>(any_iterator<ValueType, std::bidirectional_iterator_tag, Storage, Reference>&);
+
+    friend typename std::enable_if<
+        true,
+        any_iterator<ValueType, std::bidirectional_iterator_tag, Storage, Reference>
+    >::type operator--<>(any_iterator<ValueType, std::bidirectional_iterator_tag, Storage, Reference>&, int);
+};
+
+template <typename ValueType, typename Storage, typename Reference>
+struct any_iterator_base<ValueType, std::random_access_iterator_tag, Storage, Reference>
+{
+    Reference operator[](std::ptrdiff_t n) const
+    {
+        ANY_ITERATOR_STATS_OP(subscript);
+        return get_ops()->subscript(get_stg(), n);
+    }
+
+    // Address of the current element if the inner iterator is contiguous,
+    // null otherwise. Valid for past-the-end iterators too.
+    ValueType* contiguous_data() const
+    {
+        ANY_ITERATOR_STATS_OP(contiguous_data);
+        if (!get_ops()->contiguous_data)
+            return nullptr;
+        return get_ops()->contiguous_data(get_stg());
+    }
+
+    void assign_ops(erased_ops<ValueType, std::random_access_iterator_tag, Storage, Reference> const* ops) noexcept
+    {
+        static_cast<any_iterator<ValueType, std::random_access_iterator_tag, Storage, Reference>&>(*this).set_ops(ops);
+    }
+
+    erased_ops<ValueType, std::random_access_iterator_tag, Storage, Reference> const* const& get_ops() const
+    {
+        return static_cast<any_iterator<ValueType, std::random_access_iterator_tag, Storage, Reference> const&>(*this).ops;
+    }
+
+    Storage& get_stg()
+    {
+        return static_cast<any_iterator<ValueType, std::random_access_iterator_tag, Storage, Reference>&>(*this).stg;
+    }
+
+    Storage const& get_stg() const
+    {
+        return static_cast<any_iterator<ValueType, std::random_access_iterator_tag, Storage, Reference> const&>(*this).stg;
+    }
+
+    friend typename std::enable_if<
+        true,
+        any_iterator<ValueType, std::random_access_iterator_tag, Storage, Reference>&
+    >::type operator+=<>(any_iterator<ValueType, std::random_access_iterator_tag, Storage, Reference>& it, std::size_t);
+
+    friend typename std::enable_if<
+        true,
+        any_iterator<ValueType, std::random_access_iterator_tag, Storage, Reference>&
+    >::type operator-=<>(any_iterator<ValueType, std::random_access_iterator_tag, Storage, Reference>& it, std::size_t);
+
+    friend typename std::enable_if<
+        true,
+        std::ptrdiff_t
+    >::type operator-<>(any_iterator<ValueType, std::random_access_iterator_tag, Storage, Reference> const&, any_iterator<ValueType, std::random_access_iterator_tag, Storage, Reference> const&);
+
+    friend typename std::enable_if<
+        true,
+        bool
+    >::type operator< <>(any_iterator<ValueType, std::random_access_iterator_tag, Storage, Reference> const&, any_iterator<ValueType, std::random_access_iterator_tag, Storage, Reference> const&);
+};
+
+template <typename ValueType, typename Category, typename Storage, typename Reference>
+struct any_iterator : any_iterator_base<ValueType, Category, Storage, Reference>
+                    , private any_iterator_hot_ops<ValueType, Storage, Reference>
 {
     using value_type = ValueType;
     using iterator_category = Category;
     using difference_type = std::ptrdiff_t;
-    using pointer = ValueType*;
-    using reference = ValueType&;
+    using pointer = typename std::conditional<std::is_reference<Reference>::value, typename std::remove_reference<Reference>::type*, void>::type;
+    using reference = Reference;
 
     any_iterator() noexcept
-        : ops(make_null_ops<ValueType>())
-    {}
+    {
+        set_ops(make_null_ops<ValueType, Storage, Reference>());
+    }
 
+    // Any iterator whose reference converts to Reference, including
+    // iterators over classes derived from ValueType: the ops table adjusts
+    // their references to the ValueType subobject. If Reference is an lvalue
+    // reference, values converted into temporaries are rejected (see
+    // is_reference_compatible).
     template <typename InnerIteratorRef>
     any_iterator(InnerIteratorRef&& ii,
                  typename std::enable_if<
                      std::is_convertible<typename std::iterator_traits<typename std::decay<InnerIteratorRef>::type>::iterator_category*, Category*>::value
-                  && !is_any_iterator<typename std::decay<InnerIteratorRef>::type>::value
+                  && std::is_copy_constructible<typename std::decay<InnerIteratorRef>::type>::value
+                  && is_reference_compatible<typename std::iterator_traits<typename std::decay<InnerIteratorRef>::type>::reference, Reference>::value
+                  && !is_any_iterator<typename std::decay<InnerIteratorRef>::type, ValueType, Storage, Reference>::value
+                  && !is_any_contiguous_iterator<typename std::decay<InnerIteratorRef>::type>::value
                  >::type* = nullptr)
-        : ops(make_inner_iterator_ops<ValueType, typename std::decay<InnerIteratorRef>::type>())
     {
-        inner_construct<typename std::decay<InnerIteratorRef>::type>(stg, std::forward<InnerIteratorRef>(ii));
+        using inner_iterator = typename std::decay<InnerIteratorRef>::type;
+
+        // an any_iterator of another layout that holds one of this layout
+        // is unwrapped rather than nested a second time
+        if constexpr (is_wrapped_any_iterator<inner_iterator>::value)
+        {
+            if (unwrap<std::random_access_iterator_tag>(ii)
+             || unwrap<std::bidirectional_iterator_tag>(ii)
+             || unwrap<std::forward_iterator_tag>(ii))
+                return;
+        }
+
+        set_ops(make_inner_iterator_ops<ValueType, inner_iterator, Storage, Reference>());
+        inner_construct<inner_iterator>(stg, std::forward<InnerIteratorRef>(ii));
     }
 
-    template <typename OtherCategory>
-    any_iterator(any_iterator<ValueType, OtherCategory> const& other,
+    // Conversions to a more general category or from ValueType to
+    // ValueType const share the ops table of other.
+    template <typename OtherValueType, typename OtherCategory, typename OtherReference>
+    any_iterator(any_iterator<OtherValueType, OtherCategory, Storage, OtherReference> const& other,
                  typename std::enable_if<
                      std::is_convertible<OtherCategory*, Category*>::value
+                  && is_any_iterator<any_iterator<OtherValueType, OtherCategory, Storage, OtherReference>, ValueType, Storage, Reference>::value
+                  && std::is_convertible<OtherReference, Reference>::value
+                  && !is_any_contiguous_iterator<any_iterator<OtherValueType, OtherCategory, Storage, OtherReference> >::value
                  >::type* = nullptr)
-        : ops(other.ops)
     {
+        ANY_ITERATOR_STATS_OP(copy);
+        set_ops(other.ops);
         ops->copy(stg, other.stg);
     }
 
-    template <typename OtherCategory>
-    any_iterator(any_iterator<ValueType, OtherCategory>&& other,
+    template <typename OtherValueType, typename OtherCategory, typename OtherReference>
+    any_iterator(any_iterator<OtherValueType, OtherCategory, Storage, OtherReference>&& other,
                  typename std::enable_if<
                      std::is_convertible<OtherCategory*, Category*>::value
+                  && is_any_iterator<any_iterator<OtherValueType, OtherCategory, Storage, OtherReference>, ValueType, Storage, Reference>::value
+                  && std::is_convertible<OtherReference, Reference>::value
+                  && !is_any_contiguous_iterator<any_iterator<OtherValueType, OtherCategory, Storage, OtherReference> >::value
                  >::type* = nullptr)
-        : ops(other.ops)
     {
-        ops->move(stg, other.stg);
-        other.ops = make_null_ops<ValueType>();
+        ANY_ITERATOR_STATS_OP(move);
+        set_ops(other.ops);
+        move_storage(ops->move, stg, other.stg);
+        other.set_ops(make_null_ops<OtherValueType, Storage, OtherReference>());
     }
 
+#if defined(__cpp_lib_concepts)
+    // an any_contiguous_iterator is erased as the pointer it holds
+    template <typename OtherStorage>
+    any_iterator(any_iterator<ValueType, std::contiguous_iterator_tag, OtherStorage, ValueType&> const& other)
+        : any_iterator(std::to_address(other))
+    {}
+#endif
+
     any_iterator(any_iterator const& other)
-        : ops(other.ops)
     {
+        ANY_ITERATOR_STATS_OP(copy);
+        set_ops(other.ops);
         ops->copy(stg, other.stg);
     }
 
     any_iterator(any_iterator&& other) noexcept
-        : ops(other.ops)
     {
-        ops->move(stg, other.stg);
-        other.ops = make_null_ops<ValueType>();
+        ANY_ITERATOR_STATS_OP(move);
+        set_ops(other.ops);
+        move_storage(ops->move, stg, other.stg);
+        other.set_ops(make_null_ops<ValueType, Storage, Reference>());
     }
 
     ~any_iterator()
     {
+        ANY_ITERATOR_STATS_OP(destroy);
         ops->destroy(stg);
     }
 
     any_iterator& operator=(any_iterator const& rhs)
     {
+        ANY_ITERATOR_STATS_OP(assign);
         if (this != &rhs)
+        {
             rhs.ops->assign(ops, stg, rhs.stg);
+            set_ops(rhs.ops);
+        }
         return *this;
     }
 
@@ -736,189 +2067,1729 @@ struct any_iterator : any_iterator_base<ValueType, Category>
     {
         if (this != &rhs)
         {
+            ANY_ITERATOR_STATS_OP(move);
             ops->destroy(stg);
-            rhs.ops->move(stg, rhs.stg);
-            rhs.ops = make_null_ops<ValueType>();
+            move_storage(rhs.ops->move, stg, rhs.stg);
+            set_ops(rhs.ops);
+            rhs.set_ops(make_null_ops<ValueType, Storage, Reference>());
         }
         return *this;
     }
+
+    // only when Reference is a reference to the element
+    template <typename R = Reference, typename std::enable_if<std::is_lvalue_reference<R>::value>::type* = nullptr>
+    pointer operator->() const
+    {
+        return std::addressof(**this);
+    }
+
+    // Advances the iterator by up to n steps without passing end and stores
+    // pointers to the elements it steps over into out. This costs a single
+    // indirect call per batch instead of deref, preinc and eq per element.
+    // Returns the number of steps taken, which is less than n only at end.
+    // Only available when Reference is ValueType&.
+    template <typename R = Reference, typename std::enable_if<std::is_same<R, ValueType&>::value>::type* = nullptr>
+    size_t next_batch(any_iterator const& end, ValueType** out, size_t n)
+    {
+        assert(ops == end.ops);
+        ANY_ITERATOR_STATS_OP(next_batch);
+        return ops->next_batch(stg, end.stg, const_cast<typename erased_types<ValueType, Reference>::value_type**>(out), n);
+    }
+
+    // Returns the current element and increments the iterator, as *it++
+    // without the copy, in a single indirect call.
+    Reference next()
+    {
+        ANY_ITERATOR_STATS_OP(deref_inc);
+        return ops->deref_inc(stg);
+    }
+
+    // Returns a pointer to the current element and increments the iterator,
+    // or null if it is equal to end. This is a single indirect call instead
+    // of eq, deref and preinc. Only available when Reference is ValueType&.
+    template <typename R = Reference, typename std::enable_if<std::is_same<R, ValueType&>::value>::type* = nullptr>
+    ValueType* next(any_iterator const& end)
+    {
+        assert(ops == end.ops);
+        ANY_ITERATOR_STATS_OP(next);
+        return ops->next(stg, end.stg);
+    }
+
+    // next(end) that also advances ahead by a step unless it is at end, and
+    // starts loading the node it reaches into the cache. ahead is a copy of
+    // the iterator running in front of it. Only when prefetches().
+    template <typename R = Reference, typename std::enable_if<std::is_same<R, ValueType&>::value>::type* = nullptr>
+    ValueType* next_prefetched(any_iterator& ahead, any_iterator const& end)
+    {
+        assert(ops == end.ops && ops == ahead.ops && ops->next_prefetched);
+        ANY_ITERATOR_STATS_OP(next_prefetched);
+        return ops->next_prefetched(stg, ahead.stg, end.stg);
+    }
+
+    // whether the inner iterator chases pointers that next_prefetched() can
+    // load ahead of time
+    bool prefetches() const noexcept
+    {
+        return ops->next_prefetched != nullptr;
+    }
+
+    // typeid of the inner iterator, typeid(void) for an empty any_iterator
+    std::type_info const& target_type() const noexcept
+    {
+        return *ops->type;
+    }
+
+    // Swaps the storages through a temporary; no ops are called unless an
+    // inner iterator is kept inline and is not trivially relocatable.
+    friend void swap(any_iterator& lhs, any_iterator& rhs) noexcept
+    {
+        Storage tmp;
+        move_storage(lhs.ops->move, tmp, lhs.stg);
+        move_storage(rhs.ops->move, lhs.stg, rhs.stg);
+        move_storage(lhs.ops->move, rhs.stg, tmp);
+        auto lhs_ops = lhs.ops;
+        lhs.set_ops(rhs.ops);
+        rhs.set_ops(lhs_ops);
+    }
+
+    // Pointer to the inner iterator if it has type InnerIterator, null
+    // otherwise. The check is a comparison of ops table addresses. Under
+    // shared_storage the non-const overload clones a shared inner iterator.
+    template <typename InnerIterator>
+    InnerIterator* target() noexcept(!shares_heap_storage<InnerIterator, Storage>)
+    {
+        if (!holds_inner<InnerIterator>(ops))
+            return nullptr;
+        return &access<InnerIterator>(stg);
+    }
+
+    template <typename InnerIterator>
+    InnerIterator const* target() const noexcept
+    {
+        if (!holds_inner<InnerIterator>(ops))
+            return nullptr;
+        return &access<InnerIterator>(stg);
+    }
+
+    // Calls f with the inner iterator if its type is one of InnerIterators
+    // and with *this otherwise. This lets hot loops run inlined code for the
+    // common inner iterator types, f must return the same type for all.
+    template <typename... InnerIterators, typename F>
+    decltype(auto) visit(F&& f)
+    {
+        return any_iterator_visitor<InnerIterators...>::apply(*this, f);
+    }
+
+    template <typename... InnerIterators, typename F>
+    decltype(auto) visit(F&& f) const
+    {
+        return any_iterator_visitor<InnerIterators...>::apply(*this, f);
+    }
+
 private:
-    any_iterator_ops<ValueType, Category> const* ops;
-    small_storage_type stg;
+    // Copies the any_iterator<ValueType, NestedCategory, Storage, Reference>
+    // that wrapped holds, if it holds one.
+    template <typename NestedCategory, typename WrappedIterator>
+    bool unwrap(WrappedIterator const& wrapped)
+    {
+        if constexpr (std::is_convertible<NestedCategory*, Category*>::value)
+        {
+            if (auto nested = wrapped.template target<any_iterator<ValueType, NestedCategory, Storage, Reference> >())
+            {
+                ANY_ITERATOR_STATS_OP(copy);
+                set_ops(nested->ops);
+                ops->copy(stg, nested->stg);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // every change of ops goes through here to keep the hot entries in sync
+    void set_ops(erased_ops<ValueType, Category, Storage, Reference> const* new_ops) noexcept
+    {
+        ops = new_ops;
+        this->set_hot_ops(new_ops);
+    }
+
+    template <typename InnerIterator>
+    static typename std::enable_if<
+        std::is_convertible<typename std::iterator_traits<InnerIterator>::iterator_category*, Category*>::value
+     && is_reference_compatible<typename std::iterator_traits<InnerIterator>::reference, Reference>::value,
+        bool
+    >::type holds_inner(erased_ops<ValueType, Category, Storage, Reference> const* ops)
+    {
+        return ops == make_inner_iterator_ops<ValueType, InnerIterator, Storage, Reference>();
+    }
+
+    template <typename InnerIterator>
+    static typename std::enable_if<
+        !(std::is_convertible<typename std::iterator_traits<InnerIterator>::iterator_category*, Category*>::value
+       && is_reference_compatible<typename std::iterator_traits<InnerIterator>::reference, Reference>::value),
+        bool
+    >::type holds_inner(erased_ops<ValueType, Category, Storage, Reference> const*)
+    {
+        return false;
+    }
+
+    erased_ops<ValueType, Category, Storage, Reference> const* ops;
+    Storage stg;
 
-    template <typename OtherValueType, typename OtherCategory>
+    template <typename OtherValueType, typename OtherCategory, typename OtherStorage, typename OtherReference>
     friend struct any_iterator;
-    friend struct any_iterator_base<ValueType, Category>;
-    friend ValueType& operator*<>(any_iterator<ValueType, Category> const&);
+    friend struct any_range<ValueType, Category, Storage, Reference>;
+    friend struct any_sentinel<ValueType, Storage, Reference>;
+    friend struct algorithm_dispatch;
+    friend struct any_iterator_base<ValueType, Category, Storage, Reference>;
+    friend Reference operator*<>(any_iterator<ValueType, Category, Storage, Reference> const&);
     friend any_iterator& operator++<>(any_iterator& it);
     friend any_iterator operator++<>(any_iterator& it, int);
     friend bool operator==<>(any_iterator const& lhs, any_iterator const& rhs);
 };
 
-template <typename ValueType, typename Category>
-ValueType& operator*(any_iterator<ValueType, Category> const& it)
+template <typename ValueType, typename Category, typename Storage, typename Reference>
+Reference operator*(any_iterator<ValueType, Category, Storage, Reference> const& it)
 {
-    return it.ops->deref(it.stg);
+    ANY_ITERATOR_STATS_OP(deref);
+    return it.hot_deref(it.ops)(it.stg);
 }
 
-template <typename ValueType, typename Category>
-any_iterator<ValueType, Category>& operator++(any_iterator<ValueType, Category>& it)
+template <typename ValueType, typename Category, typename Storage, typename Reference>
+any_iterator<ValueType, Category, Storage, Reference>& operator++(any_iterator<ValueType, Category, Storage, Reference>& it)
 {
-    it.ops->preinc(it.stg);
+    ANY_ITERATOR_STATS_OP(preinc);
+    it.hot_preinc(it.ops)(it.stg);
     return it;
 }
 
-template <typename ValueType, typename Category>
-any_iterator<ValueType, Category> operator++(any_iterator<ValueType, Category>& it, int)
+template <typename ValueType, typename Category, typename Storage, typename Reference>
+any_iterator<ValueType, Category, Storage, Reference> operator++(any_iterator<ValueType, Category, Storage, Reference>& it, int)
 {
-    any_iterator<ValueType, Category> copy;
+    any_iterator<ValueType, Category, Storage, Reference> copy;
+    ANY_ITERATOR_STATS_OP(postinc);
     it.ops->postinc(copy.stg, it.stg);
-    copy.ops = it.ops;
+    copy.set_ops(it.ops);
     return copy;
 }
 
-template <typename ValueType, typename Category>
-bool operator==(any_iterator<ValueType, Category> const& lhs, any_iterator<ValueType, Category> const& rhs)
+template <typename ValueType, typename Category, typename Storage, typename Reference>
+bool operator==(any_iterator<ValueType, Category, Storage, Reference> const& lhs, any_iterator<ValueType, Category, Storage, Reference> const& rhs)
 {
     assert(lhs.ops == rhs.ops);
-    return lhs.ops->eq(lhs.stg, rhs.stg);
+    ANY_ITERATOR_STATS_OP(eq);
+    return lhs.hot_eq(lhs.ops)(lhs.stg, rhs.stg);
 }
 
-template <typename ValueType, typename Category>
-bool operator!=(any_iterator<ValueType, Category> const& lhs, any_iterator<ValueType, Category> const& rhs)
+template <typename ValueType, typename Category, typename Storage, typename Reference>
+bool operator!=(any_iterator<ValueType, Category, Storage, Reference> const& lhs, any_iterator<ValueType, Category, Storage, Reference> const& rhs)
 {
     return !(lhs == rhs);
 }
 
-template <typename ValueType, typename Category>
+template <typename ValueType, typename Category, typename Storage, typename Reference>
 typename std::enable_if<
     std::is_convertible<Category*, std::bidirectional_iterator_tag*>::value,
-    any_iterator<ValueType, Category>&
->::type operator--(any_iterator<ValueType, Category>& it)
+    any_iterator<ValueType, Category, Storage, Reference>&
+>::type operator--(any_iterator<ValueType, Category, Storage, Reference>& it)
 {
+    ANY_ITERATOR_STATS_OP(predec);
     it.get_ops()->predec(it.get_stg());
     return it;
 }
 
-template <typename ValueType, typename Category>
+template <typename ValueType, typename Category, typename Storage, typename Reference>
 typename std::enable_if<
     std::is_convertible<Category*, std::bidirectional_iterator_tag*>::value,
-    any_iterator<ValueType, Category>
->::type operator--(any_iterator<ValueType, Category>& it, int)
+    any_iterator<ValueType, Category, Storage, Reference>
+>::type operator--(any_iterator<ValueType, Category, Storage, Reference>& it, int)
 {
-    any_iterator<ValueType, Category> copy;
+    any_iterator<ValueType, Category, Storage, Reference> copy;
+    ANY_ITERATOR_STATS_OP(postdec);
     it.get_ops()->postdec(copy.get_stg(), it.get_stg());
-    copy.get_ops() = it.get_ops();
+    copy.assign_ops(it.get_ops());
     return copy;
 }
 
-template <typename ValueType, typename Category>
+template <typename ValueType, typename Category, typename Storage, typename Reference>
 typename std::enable_if<
     std::is_convertible<Category*, std::random_access_iterator_tag*>::value,
-    any_iterator<ValueType, Category>&
->::type operator+=(any_iterator<ValueType, Category>& it, std::size_t n)
+    any_iterator<ValueType, Category, Storage, Reference>&
+>::type operator+=(any_iterator<ValueType, Category, Storage, Reference>& it, std::size_t n)
 {
+    ANY_ITERATOR_STATS_OP(add);
     it.get_ops()->add(it.get_stg(), n);
     return it;
 }
 
-template <typename ValueType, typename Category>
+template <typename ValueType, typename Category, typename Storage, typename Reference>
 typename std::enable_if<
     std::is_convertible<Category*, std::random_access_iterator_tag*>::value,
-    any_iterator<ValueType, Category>&
->::type operator-=(any_iterator<ValueType, Category>& it, std::size_t n)
+    any_iterator<ValueType, Category, Storage, Reference>&
+>::type operator-=(any_iterator<ValueType, Category, Storage, Reference>& it, std::size_t n)
 {
+    ANY_ITERATOR_STATS_OP(sub);
     it.get_ops()->sub(it.get_stg(), n);
     return it;
 }
 
-template <typename ValueType, typename Category>
+template <typename ValueType, typename Category, typename Storage, typename Reference>
 typename std::enable_if<
     std::is_convertible<Category*, std::random_access_iterator_tag*>::value,
     std::ptrdiff_t
->::type operator-(any_iterator<ValueType, Category> const& lhs, any_iterator<ValueType, Category> const& rhs)
+>::type operator-(any_iterator<ValueType, Category, Storage, Reference> const& lhs, any_iterator<ValueType, Category, Storage, Reference> const& rhs)
 {
     assert(lhs.get_ops() == rhs.get_ops());
+    ANY_ITERATOR_STATS_OP(diff);
     return lhs.get_ops()->diff(lhs.get_stg(), rhs.get_stg());
 }
 
-template <typename ValueType, typename Category>
+template <typename ValueType, typename Category, typename Storage, typename Reference>
 typename std::enable_if<
     std::is_convertible<Category*, std::random_access_iterator_tag*>::value,
     bool
->::type operator<(any_iterator<ValueType, Category> const& lhs, any_iterator<ValueType, Category> const& rhs)
+>::type operator<(any_iterator<ValueType, Category, Storage, Reference> const& lhs, any_iterator<ValueType, Category, Storage, Reference> const& rhs)
 {
     assert(lhs.get_ops() == rhs.get_ops());
+    ANY_ITERATOR_STATS_OP(lt);
     return lhs.get_ops()->lt(lhs.get_stg(), rhs.get_stg());
 }
 
-template <typename ValueType, typename Category>
+template <typename ValueType, typename Category, typename Storage, typename Reference>
 typename std::enable_if<
     std::is_convertible<Category*, std::random_access_iterator_tag*>::value,
     bool
->::type operator<=(any_iterator<ValueType, Category> const& lhs, any_iterator<ValueType, Category> const& rhs)
+>::type operator<=(any_iterator<ValueType, Category, Storage, Reference> const& lhs, any_iterator<ValueType, Category, Storage, Reference> const& rhs)
 {
     return !(rhs < lhs);
 }
 
-template <typename ValueType, typename Category>
+template <typename ValueType, typename Category, typename Storage, typename Reference>
 typename std::enable_if<
     std::is_convertible<Category*, std::random_access_iterator_tag*>::value,
     bool
->::type operator>(any_iterator<ValueType, Category> const& lhs, any_iterator<ValueType, Category> const& rhs)
+>::type operator>(any_iterator<ValueType, Category, Storage, Reference> const& lhs, any_iterator<ValueType, Category, Storage, Reference> const& rhs)
 {
     return rhs < lhs;
 }
 
-template <typename ValueType, typename Category>
+template <typename ValueType, typename Category, typename Storage, typename Reference>
 typename std::enable_if<
     std::is_convertible<Category*, std::random_access_iterator_tag*>::value,
     bool
->::type operator>=(any_iterator<ValueType, Category> const& lhs, any_iterator<ValueType, Category> const& rhs)
+>::type operator>=(any_iterator<ValueType, Category, Storage, Reference> const& lhs, any_iterator<ValueType, Category, Storage, Reference> const& rhs)
 {
     return !(lhs < rhs);
 }
 
-template <typename ValueType, typename Category>
+template <typename ValueType, typename Category, typename Storage, typename Reference>
 typename std::enable_if<
     std::is_convertible<Category*, std::random_access_iterator_tag*>::value,
-    any_iterator<ValueType, Category>
->::type operator+(any_iterator<ValueType, Category> it, std::size_t n)
+    any_iterator<ValueType, Category, Storage, Reference>
+>::type operator+(any_iterator<ValueType, Category, Storage, Reference> it, std::size_t n)
 {
     it += n;
     return it;
 }
 
-template <typename ValueType, typename Category>
+template <typename ValueType, typename Category, typename Storage, typename Reference>
 typename std::enable_if<
     std::is_convertible<Category*, std::random_access_iterator_tag*>::value,
-    any_iterator<ValueType, Category>
->::type operator+(std::size_t n, any_iterator<ValueType, Category> it)
+    any_iterator<ValueType, Category, Storage, Reference>
+>::type operator+(std::size_t n, any_iterator<ValueType, Category, Storage, Reference> it)
 {
     it += n;
     return it;
 }
 
-template <typename ValueType, typename Category>
+template <typename ValueType, typename Category, typename Storage, typename Reference>
 typename std::enable_if<
     std::is_convertible<Category*, std::random_access_iterator_tag*>::value,
-    any_iterator<ValueType, Category>
->::type operator-(any_iterator<ValueType, Category> it, std::size_t n)
+    any_iterator<ValueType, Category, Storage, Reference>
+>::type operator-(any_iterator<ValueType, Category, Storage, Reference> it, std::size_t n)
 {
     it -= n;
     return it;
 }
 
+// Sentinel ops are bound to one inner iterator type: eq compares an inner
+// iterator of that type with the stored sentinel in a single call.
+template <typename ValueType, typename Storage, typename Reference>
+struct any_sentinel_ops
+{
+    using copy_t = void (*)(Storage& dst, Storage const& src);
+    // null if the storage can be moved by copying its bytes
+    using move_t = void (*)(Storage& dst, Storage& src);
+    using destroy_t = void (*)(Storage& obj);
+    using eq_t = bool (*)(Storage const& it, Storage const& s);
+
+    eq_t eq;
+
+    // ops of the iterators this sentinel can be compared with
+    erased_ops<ValueType, std::forward_iterator_tag, Storage, Reference> const* iterator_ops;
+
+    std::type_info const* type;
+
+    copy_t copy;
+    move_t move;
+    destroy_t destroy;
+
+    constexpr any_sentinel_ops(erased_ops<ValueType, std::forward_iterator_tag, Storage, Reference> const* iterator_ops,
+                               std::type_info const* type,
+                               copy_t copy, move_t move, destroy_t destroy,
+                               eq_t eq)
+        : eq(eq)
+        , iterator_ops(iterator_ops)
+        , type(type)
+        , copy(copy)
+        , move(move)
+        , destroy(destroy)
+    {}
+};
+
+// Like the range ops tables these refer to the iterator ops tables and are
+// initialized dynamically.
+template <typename ValueType, typename Storage, typename Reference>
+inline any_sentinel_ops<ValueType, Storage, Reference> const* make_null_sentinel_ops()
+{
+    static any_sentinel_ops<ValueType, Storage, Reference> const instance
+    (
+        make_null_ops<ValueType, Storage, Reference>(),
+        &typeid(void),
+        &null_clone<Storage>,
+        nullptr,
+        &null_destroy<Storage>,
+        &null_eq<Storage>
+    );
+
+    return &instance;
+}
+
+template <typename InnerIterator, typename Sentinel, typename Storage>
+bool inner_sentinel_eq(Storage const& it, Storage const& s)
+{
+    return access<InnerIterator>(it) == access<Sentinel>(s);
 }
 
-using any_iterator_impl::bad_any_iterator;
-using any_iterator_impl::any_iterator;
+template <typename ValueType, typename InnerIterator, typename Sentinel, typename Storage, typename Reference>
+any_sentinel_ops<ValueType, Storage, Reference> const* make_inner_sentinel_ops()
+{
+    static any_sentinel_ops<ValueType, Storage, Reference> const instance
+    (
+        make_inner_iterator_ops<ValueType, InnerIterator, Storage, Reference>(),
+        &typeid(Sentinel),
+        &inner_copy<Sentinel, Storage>,
+        make_inner_move<Sentinel, Storage>(),
+        &inner_destroy<Sentinel, Storage>,
+        &inner_sentinel_eq<InnerIterator, Sentinel, Storage>
+    );
 
-template <typename ValueType>
-using any_forward_iterator = any_iterator<ValueType, std::forward_iterator_tag>;
+    return &instance;
+}
 
-template <typename ValueType>
-using any_bidirectional_iterator = any_iterator<ValueType, std::bidirectional_iterator_tag>;
+// End marker of any type for any_iterators over InnerIterator, such as
+// std::default_sentinel_t, null_sentinel or an end iterator. Comparing an
+// any_iterator with it is a single indirect call and a small sentinel is
+// kept inline, so ranges without a natural end iterator don't need one.
+// It compares with any_iterators of every category holding InnerIterator.
+template <typename ValueType, typename Storage, typename Reference>
+struct any_sentinel
+{
+    any_sentinel() noexcept
+        : ops(make_null_sentinel_ops<ValueType, Storage, Reference>())
+    {}
 
-template <typename ValueType>
-using any_random_access_iterator = any_iterator<ValueType, std::random_access_iterator_tag>;
+    template <typename InnerIterator, typename Sentinel>
+    any_sentinel(std::in_place_type_t<InnerIterator>, Sentinel s,
+                 typename std::enable_if<
+                     std::is_convertible<decltype(std::declval<InnerIterator const&>() == std::declval<Sentinel const&>()), bool>::value
+                 >::type* = nullptr)
+        : ops(make_inner_sentinel_ops<ValueType, InnerIterator, Sentinel, Storage, Reference>())
+    {
+        inner_construct<Sentinel>(stg, std::move(s));
+    }
+
+    any_sentinel(any_sentinel const& other)
+        : ops(other.ops)
+    {
+        ops->copy(stg, other.stg);
+    }
+
+    any_sentinel(any_sentinel&& other) noexcept
+        : ops(other.ops)
+    {
+        move_storage(ops->move, stg, other.stg);
+        other.ops = make_null_sentinel_ops<ValueType, Storage, Reference>();
+    }
+
+    ~any_sentinel()
+    {
+        ops->destroy(stg);
+    }
+
+    any_sentinel& operator=(any_sentinel const& rhs)
+    {
+        if (this != &rhs)
+            *this = any_sentinel(rhs);
+        return *this;
+    }
+
+    any_sentinel& operator=(any_sentinel&& rhs) noexcept
+    {
+        if (this != &rhs)
+        {
+            ops->destroy(stg);
+            ops = rhs.ops;
+            move_storage(ops->move, stg, rhs.stg);
+            rhs.ops = make_null_sentinel_ops<ValueType, Storage, Reference>();
+        }
+        return *this;
+    }
+
+    // typeid of the sentinel, typeid(void) for an empty any_sentinel
+    std::type_info const& target_type() const noexcept
+    {
+        return *ops->type;
+    }
+
+    template <typename Category>
+    friend bool operator==(any_iterator<ValueType, Category, Storage, Reference> const& it, any_sentinel const& s)
+    {
+        return s.reached(it);
+    }
+
+    template <typename Category>
+    friend bool operator==(any_sentinel const& s, any_iterator<ValueType, Category, Storage, Reference> const& it)
+    {
+        return s.reached(it);
+    }
+
+    template <typename Category>
+    friend bool operator!=(any_iterator<ValueType, Category, Storage, Reference> const& it, any_sentinel const& s)
+    {
+        return !s.reached(it);
+    }
+
+    template <typename Category>
+    friend bool operator!=(any_sentinel const& s, any_iterator<ValueType, Category, Storage, Reference> const& it)
+    {
+        return !s.reached(it);
+    }
+
+private:
+    template <typename Category>
+    bool reached(any_iterator<ValueType, Category, Storage, Reference> const& it) const
+    {
+        assert(ops->iterator_ops == it.ops);
+        ANY_ITERATOR_STATS_OP(sentinel_eq);
+        return ops->eq(it.stg, stg);
+    }
+
+    any_sentinel_ops<ValueType, Storage, Reference> const* ops;
+    Storage stg;
+};
+
+// Sentinel of null-terminated sequences such as C strings
+struct null_sentinel
+{
+    template <typename InnerIterator>
+    friend bool operator==(InnerIterator const& it, null_sentinel)
+    {
+        return *it == typename std::iterator_traits<InnerIterator>::value_type();
+    }
+
+    template <typename InnerIterator>
+    friend bool operator!=(InnerIterator const& it, null_sentinel)
+    {
+        return !(it == null_sentinel());
+    }
+};
+
+#if defined(__cpp_lib_concepts)
+// Contiguous category: the erased state is just a pointer to the current
+// element, so all operations are plain pointer arithmetic without dispatch
+// and the iterator models std::contiguous_iterator. Any contiguous iterator
+// over ValueType converts to it and it converts to the other categories.
+template <typename ValueType, typename Storage>
+struct any_iterator<ValueType, std::contiguous_iterator_tag, Storage, ValueType&>
+{
+    using value_type = typename std::remove_cv<ValueType>::type;
+    using iterator_category = std::random_access_iterator_tag;
+    using iterator_concept = std::contiguous_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using pointer = ValueType*;
+    using reference = ValueType&;
+
+    any_iterator() noexcept
+        : ptr(nullptr)
+    {}
+
+    // requires rather than enable_if: the conjunction must short-circuit
+    // before checking the concept on any_iterator itself
+    template <typename InnerIterator>
+        requires (!std::is_same<InnerIterator, any_iterator>::value)
+              && std::contiguous_iterator<InnerIterator>
+              && std::is_same<typename std::remove_cv<std::iter_value_t<InnerIterator> >::type, value_type>::value
+              && std::is_convertible<decltype(std::to_address(std::declval<InnerIterator const&>())), ValueType*>::value
+    any_iterator(InnerIterator const& it)
+        : ptr(std::to_address(it))
+    {}
+
+    ValueType& operator*() const noexcept
+    {
+        return *ptr;
+    }
+
+    ValueType* operator->() const noexcept
+    {
+        return ptr;
+    }
+
+    ValueType& operator[](std::ptrdiff_t n) const noexcept
+    {
+        return ptr[n];
+    }
+
+    any_iterator& operator++() noexcept
+    {
+        ++ptr;
+        return *this;
+    }
+
+    any_iterator operator++(int) noexcept
+    {
+        any_iterator copy = *this;
+        ++ptr;
+        return copy;
+    }
+
+    any_iterator& operator--() noexcept
+    {
+        --ptr;
+        return *this;
+    }
+
+    any_iterator operator--(int) noexcept
+    {
+        any_iterator copy = *this;
+        --ptr;
+        return copy;
+    }
+
+    any_iterator& operator+=(std::ptrdiff_t n) noexcept
+    {
+        ptr += n;
+        return *this;
+    }
+
+    any_iterator& operator-=(std::ptrdiff_t n) noexcept
+    {
+        ptr -= n;
+        return *this;
+    }
+
+    friend any_iterator operator+(any_iterator it, std::ptrdiff_t n) noexcept
+    {
+        return it += n;
+    }
+
+    friend any_iterator operator+(std::ptrdiff_t n, any_iterator it) noexcept
+    {
+        return it += n;
+    }
+
+    friend any_iterator operator-(any_iterator it, std::ptrdiff_t n) noexcept
+    {
+        return it -= n;
+    }
+
+    friend std::ptrdiff_t operator-(any_iterator const& lhs, any_iterator const& rhs) noexcept
+    {
+        return lhs.ptr - rhs.ptr;
+    }
+
+    friend bool operator==(any_iterator const& lhs, any_iterator const& rhs) noexcept
+    {
+        return lhs.ptr == rhs.ptr;
+    }
+
+    friend bool operator!=(any_iterator const& lhs, any_iterator const& rhs) noexcept
+    {
+        return lhs.ptr != rhs.ptr;
+    }
+
+    friend bool operator<(any_iterator const& lhs, any_iterator const& rhs) noexcept
+    {
+        return lhs.ptr < rhs.ptr;
+    }
+
+    friend bool operator<=(any_iterator const& lhs, any_iterator const& rhs) noexcept
+    {
+        return lhs.ptr <= rhs.ptr;
+    }
+
+    friend bool operator>(any_iterator const& lhs, any_iterator const& rhs) noexcept
+    {
+        return lhs.ptr > rhs.ptr;
+    }
+
+    friend bool operator>=(any_iterator const& lhs, any_iterator const& rhs) noexcept
+    {
+        return lhs.ptr >= rhs.ptr;
+    }
+
+private:
+    ValueType* ptr;
+};
+#endif
+
+// Only forward any_iterators have an algorithm table: single pass ones have
+// a reduced ops table and any_contiguous_iterator holds a plain pointer.
+template <typename AnyIterator>
+constexpr bool is_dispatched
+    = std::is_convertible<typename AnyIterator::iterator_category*, std::forward_iterator_tag*>::value
+   && !is_any_contiguous_iterator<AnyIterator>::value;
+
+template <typename AnyIterator>
+using enable_if_dispatched = typename std::enable_if<is_dispatched<AnyIterator> >::type;
+
+// Gives the algorithm overloads below access to the algorithm table and
+// the storage of any_iterators.
+struct algorithm_dispatch
+{
+    // the algorithm table of the inner iterator of first and last, null if
+    // they are empty or hold different types
+    template <typename AnyIterator, typename = enable_if_dispatched<AnyIterator> >
+    static auto algorithms(AnyIterator const& first, AnyIterator const& last) noexcept
+    {
+        return first.ops == last.ops ? first.ops->algorithms : nullptr;
+    }
+
+    template <typename AnyIterator, typename = enable_if_dispatched<AnyIterator> >
+    static bool same_inner(AnyIterator const& lhs, AnyIterator const& rhs) noexcept
+    {
+        return lhs.ops == rhs.ops;
+    }
+
+    template <typename AnyIterator, typename = enable_if_dispatched<AnyIterator> >
+    static auto& storage(AnyIterator& it) noexcept
+    {
+        return it.stg;
+    }
+};
+
+template <typename InputIterator, typename OutputIterator>
+OutputIterator contiguous_copy(InputIterator first, InputIterator last, OutputIterator out)
+{
+    return std::copy(first, last, out);
+}
+
+// copies to contiguous outputs with the copy kernel of the inner iterator
+template <typename ValueType, typename Category, typename Storage, typename Reference, typename OutputIterator,
+          typename = enable_if_dispatched<any_iterator<ValueType, Category, Storage, Reference> > >
+typename std::enable_if<has_contiguous_data<ValueType, OutputIterator>, OutputIterator>::type contiguous_copy(any_iterator<ValueType, Category, Storage, Reference> const& first,
+                                                                                                             any_iterator<ValueType, Category, Storage, Reference> const& last,
+                                                                                                             OutputIterator out)
+{
+    auto algorithms = algorithm_dispatch::algorithms(first, last);
+    if (algorithms && algorithms->copy)
+    {
+        auto dst = inner_to_address(out);
+        return out + (algorithms->copy(algorithm_dispatch::storage(first), algorithm_dispatch::storage(last), dst) - dst);
+    }
+    return std::copy(first, last, out);
+}
+
+template <typename InputIterator, typename ValueType, typename Storage>
+any_iterator<ValueType, std::random_access_iterator_tag, Storage> contiguous_copy(InputIterator first, InputIterator last,
+                                                                                 any_iterator<ValueType, std::random_access_iterator_tag, Storage> out)
+{
+    if (ValueType* dst = out.contiguous_data())
+    {
+        out += contiguous_copy(first, last, dst) - dst;
+        return out;
+    }
+    return std::copy(first, last, std::move(out));
+}
+
+// Overloads of std::copy, std::fill and std::equal for random access
+// any_iterators. When the inner iterators are contiguous they run on raw
+// pointers (memmove/memset/memcmp for trivial types) instead of dispatching
+// every element through the ops table.
+template <typename ValueType, typename Storage, typename OutputIterator>
+OutputIterator copy(any_iterator<ValueType, std::random_access_iterator_tag, Storage> const& first,
+                    any_iterator<ValueType, std::random_access_iterator_tag, Storage> const& last,
+                    OutputIterator out)
+{
+    if (ValueType* src = first.contiguous_data())
+        return contiguous_copy(src, src + (last - first), std::move(out));
+    return contiguous_copy(first, last, std::move(out));
+}
+
+template <typename ValueType, typename Storage, typename T>
+void fill(any_iterator<ValueType, std::random_access_iterator_tag, Storage> const& first,
+          any_iterator<ValueType, std::random_access_iterator_tag, Storage> const& last,
+          T const& value)
+{
+    if (ValueType* dst = first.contiguous_data())
+        std::fill(dst, dst + (last - first), value);
+    else
+        std::fill(first, last, value);
+}
+
+template <typename ValueType, typename Storage, typename OtherValueType, typename OtherStorage>
+bool equal(any_iterator<ValueType, std::random_access_iterator_tag, Storage> const& first1,
+           any_iterator<ValueType, std::random_access_iterator_tag, Storage> const& last1,
+           any_iterator<OtherValueType, std::random_access_iterator_tag, OtherStorage> const& first2)
+{
+    ValueType* lhs = first1.contiguous_data();
+    OtherValueType* rhs = first2.contiguous_data();
+    if (lhs && rhs)
+        return std::equal(lhs, lhs + (last1 - first1), rhs);
+    if (lhs)
+        return std::equal(lhs, lhs + (last1 - first1), first2);
+    if (rhs)
+        return std::equal(first1, last1, rhs);
+
+    if constexpr (std::is_same<decltype(first1), decltype(first2)>::value)
+    {
+        auto algorithms = algorithm_dispatch::algorithms(first1, last1);
+        if (algorithms && algorithms->equal && algorithm_dispatch::same_inner(first1, first2))
+            return algorithms->equal(algorithm_dispatch::storage(first1), algorithm_dispatch::storage(last1), algorithm_dispatch::storage(first2));
+    }
+    return std::equal(first1, last1, first2);
+}
+
+// Overloads of std::copy and std::for_each for forward and bidirectional
+// any_iterators, they make a single indirect call per element through
+// next(end) instead of eq, deref and preinc.
+template <typename ValueType, typename Category, typename Storage, typename OutputIterator,
+          typename std::enable_if<std::is_convertible<Category*, std::forward_iterator_tag*>::value
+                               && !std::is_convertible<Category*, std::random_access_iterator_tag*>::value>::type* = nullptr>
+OutputIterator copy(any_iterator<ValueType, Category, Storage> first,
+                    any_iterator<ValueType, Category, Storage> const& last,
+                    OutputIterator out)
+{
+    if constexpr (has_contiguous_data<ValueType, OutputIterator>)
+        return contiguous_copy(first, last, out);
+
+    while (ValueType* p = first.next(last))
+    {
+        *out = *p;
+        ++out;
+    }
+    return out;
+}
+
+template <typename ValueType, typename Category, typename Storage, typename F,
+          typename std::enable_if<std::is_convertible<Category*, std::forward_iterator_tag*>::value
+                               && !std::is_convertible<Category*, std::random_access_iterator_tag*>::value>::type* = nullptr>
+F for_each(any_iterator<ValueType, Category, Storage> first, any_iterator<ValueType, Category, Storage> const& last, F f)
+{
+    while (ValueType* p = first.next(last))
+        f(*p);
+    return f;
+}
+
+template <typename ValueType, typename Category, typename Storage, typename Reference,
+          typename std::enable_if<std::is_convertible<Category*, std::forward_iterator_tag*>::value
+                               && !std::is_convertible<Category*, std::random_access_iterator_tag*>::value>::type* = nullptr>
+bool equal(any_iterator<ValueType, Category, Storage, Reference> const& first1,
+           any_iterator<ValueType, Category, Storage, Reference> const& last1,
+           any_iterator<ValueType, Category, Storage, Reference> const& first2)
+{
+    auto algorithms = algorithm_dispatch::algorithms(first1, last1);
+    if (algorithms && algorithms->equal && algorithm_dispatch::same_inner(first1, first2))
+        return algorithms->equal(algorithm_dispatch::storage(first1), algorithm_dispatch::storage(last1), algorithm_dispatch::storage(first2));
+    return std::equal(first1, last1, first2);
+}
+
+// Overloads of std::find, std::count, std::accumulate and std::lower_bound
+// that make one indirect call to the algorithm instantiated for the inner
+// iterator, which then runs fully inlined. They fall back to the generic
+// algorithm if value is not of the iterator's value_type, the iterators
+// hold different inner types or the elements lack the needed operator.
+template <typename ValueType, typename Category, typename Storage, typename Reference, typename T,
+          typename = enable_if_dispatched<any_iterator<ValueType, Category, Storage, Reference> > >
+any_iterator<ValueType, Category, Storage, Reference> find(any_iterator<ValueType, Category, Storage, Reference> first,
+                                                          any_iterator<ValueType, Category, Storage, Reference> const& last,
+                                                          T const& value)
+{
+    if constexpr (std::is_same<T, typename std::remove_cv<ValueType>::type>::value)
+    {
+        auto algorithms = algorithm_dispatch::algorithms(first, last);
+        if (algorithms && algorithms->find)
+        {
+            algorithms->find(algorithm_dispatch::storage(first), algorithm_dispatch::storage(last), value);
+            return first;
+        }
+    }
+    return std::find(std::move(first), last, value);
+}
+
+template <typename ValueType, typename Category, typename Storage, typename Reference, typename T,
+          typename = enable_if_dispatched<any_iterator<ValueType, Category, Storage, Reference> > >
+std::ptrdiff_t count(any_iterator<ValueType, Category, Storage, Reference> const& first,
+                     any_iterator<ValueType, Category, Storage, Reference> const& last,
+                     T const& value)
+{
+    if constexpr (std::is_same<T, typename std::remove_cv<ValueType>::type>::value)
+    {
+        auto algorithms = algorithm_dispatch::algorithms(first, last);
+        if (algorithms && algorithms->count)
+            return algorithms->count(algorithm_dispatch::storage(first), algorithm_dispatch::storage(last), value);
+    }
+    return std::count(first, last, value);
+}
+
+template <typename ValueType, typename Category, typename Storage, typename Reference, typename T,
+          typename = enable_if_dispatched<any_iterator<ValueType, Category, Storage, Reference> > >
+T accumulate(any_iterator<ValueType, Category, Storage, Reference> const& first,
+             any_iterator<ValueType, Category, Storage, Reference> const& last,
+             T init)
+{
+    if constexpr (std::is_same<T, typename std::remove_cv<ValueType>::type>::value)
+    {
+        auto algorithms = algorithm_dispatch::algorithms(first, last);
+        if (algorithms && algorithms->accumulate)
+        {
+            algorithms->accumulate(algorithm_dispatch::storage(first), algorithm_dispatch::storage(last), init);
+            return init;
+        }
+    }
+    return std::accumulate(first, last, std::move(init));
+}
+
+template <typename ValueType, typename Category, typename Storage, typename Reference, typename T,
+          typename = enable_if_dispatched<any_iterator<ValueType, Category, Storage, Reference> > >
+any_iterator<ValueType, Category, Storage, Reference> lower_bound(any_iterator<ValueType, Category, Storage, Reference> first,
+                                                                 any_iterator<ValueType, Category, Storage, Reference> const& last,
+                                                                 T const& value)
+{
+    if constexpr (std::is_same<T, typename std::remove_cv<ValueType>::type>::value)
+    {
+        auto algorithms = algorithm_dispatch::algorithms(first, last);
+        if (algorithms && algorithms->lower_bound)
+        {
+            algorithms->lower_bound(algorithm_dispatch::storage(first), algorithm_dispatch::storage(last), value);
+            return first;
+        }
+    }
+    return std::lower_bound(std::move(first), last, value);
+}
+
+constexpr size_t default_batch_size = 64;
+
+// Calls f(ValueType* const* chunk, size_t n) for consecutive chunks of
+// [first, last), fetching each chunk with a single next_batch call.
+template <typename ValueType, typename Category, typename Storage, typename F>
+F for_each_chunk(any_iterator<ValueType, Category, Storage> first, any_iterator<ValueType, Category, Storage> const& last, F f)
+{
+    ValueType* chunk[default_batch_size];
+    for (;;)
+    {
+        size_t n = first.next_batch(last, chunk, default_batch_size);
+        if (n != 0)
+            f(static_cast<ValueType* const*>(chunk), n);
+        if (n != default_batch_size)
+            return f;
+    }
+}
+
+constexpr size_t default_prefetch_distance = 8;
+
+// for_each with a look-ahead cursor running distance elements in front of
+// f: the cursor prefetches each node it reaches, so the node it reads next
+// is loading while f runs, and the nodes f's iterator reaches are already
+// cached. Every element costs a single indirect call that advances both.
+// Inner iterators that don't chase pointers run a plain for_each.
+template <typename ValueType, typename Category, typename Storage, typename F>
+F for_each_prefetched(any_iterator<ValueType, Category, Storage> first, any_iterator<ValueType, Category, Storage> const& last,
+                      size_t distance, F f)
+{
+    if (!first.prefetches())
+        return for_each(std::move(first), last, std::move(f));
+
+    any_iterator<ValueType, Category, Storage> ahead = first;
+    for (size_t n = 0; n != distance && ahead.next(last); ++n)
+    {}
+    while (ValueType* p = first.next_prefetched(ahead, last))
+        f(*p);
+    return f;
+}
+
+// any_range keeps both ends of a range in one storage block twice the size
+// of an iterator's, so big inner iterators cost a single allocation per range.
+template <typename Storage>
+using range_storage = typename std::conditional<
+    Storage::trivially_relocatable,
+    relocatable_storage<inline_storage<2 * Storage::size, Storage::alignment, typename Storage::allocator_type> >,
+    inline_storage<2 * Storage::size, Storage::alignment, typename Storage::allocator_type>
+>::type;
+
+template <typename InnerIterator, typename Sentinel = InnerIterator>
+struct inner_range
+{
+    InnerIterator first;
+    Sentinel last;
+};
+
+template <typename InnerIterator, typename Sentinel>
+struct is_trivially_relocatable<inner_range<InnerIterator, Sentinel> >
+    : std::integral_constant<bool, is_trivially_relocatable<InnerIterator>::value && is_trivially_relocatable<Sentinel>::value>
+{};
+
+template <typename ValueType, typename Category, typename Storage, typename Reference>
+struct any_range_ops
+{
+    using copy_t = void (*)(range_storage<Storage>& dst, range_storage<Storage> const& src);
+    // null if the storage can be moved by copying its bytes
+    using move_t = void (*)(range_storage<Storage>& dst, range_storage<Storage>& src);
+    using destroy_t = void (*)(range_storage<Storage>& obj);
+
+    using begin_t = void (*)(Storage& dst, range_storage<Storage> const& src);
+    using end_t = void (*)(Storage& dst, range_storage<Storage> const& src);
+    using empty_t = bool (*)(range_storage<Storage> const& obj);
+    using size_t_ = size_t (*)(range_storage<Storage> const& obj);
+    using data_t = ValueType* (*)(range_storage<Storage> const& obj);
+
+    erased_ops<ValueType, Category, Storage, Reference> const* iterator_ops;
+
+    copy_t copy;
+    move_t move;
+    destroy_t destroy;
+
+    begin_t begin;
+    end_t end;
+    empty_t empty;
+    size_t_ size;
+    data_t data;
+
+    constexpr any_range_ops(erased_ops<ValueType, Category, Storage, Reference> const* iterator_ops,
+                            copy_t copy, move_t move, destroy_t destroy,
+                            begin_t begin, end_t end,
+                            empty_t empty, size_t_ size, data_t data)
+        : iterator_ops(iterator_ops)
+        , copy(copy)
+        , move(move)
+        , destroy(destroy)
+        , begin(begin)
+        , end(end)
+        , empty(empty)
+        , size(size)
+        , data(data)
+    {}
+};
+
+template <typename Storage>
+void null_range_begin(Storage&, range_storage<Storage> const&)
+{}
+
+template <typename Storage>
+bool null_range_empty(range_storage<Storage> const&)
+{
+    return true;
+}
+
+template <typename Storage>
+size_t null_range_size(range_storage<Storage> const&)
+{
+    return 0;
+}
+
+template <typename ValueType, typename Storage>
+ValueType* null_range_data(range_storage<Storage> const&)
+{
+    return nullptr;
+}
+
+// The range ops tables refer to the iterator ops tables, which aren't
+// constant expressions, so unlike those they are initialized dynamically.
+template <typename ValueType, typename Category, typename Storage, typename Reference>
+inline any_range_ops<ValueType, Category, Storage, Reference> const* make_null_range_ops()
+{
+    static any_range_ops<ValueType, Category, Storage, Reference> const instance
+    (
+        make_null_ops<ValueType, Storage, Reference>(),
+
+        &null_clone<range_storage<Storage> >,
+        nullptr,
+        &null_destroy<range_storage<Storage> >,
+
+        &null_range_begin<Storage>,
+        &null_range_begin<Storage>,
+        &null_range_empty<Storage>,
+        &null_range_size<Storage>,
+        &null_range_data<ValueType, Storage>
+    );
+
+    return &instance;
+}
+
+template <typename InnerIterator, typename Storage>
+void inner_range_begin(Storage& dst, range_storage<Storage> const& src)
+{
+    inner_construct<InnerIterator>(dst, access<inner_range<InnerIterator> >(src).first);
+}
+
+template <typename InnerIterator, typename Storage>
+void inner_range_end(Storage& dst, range_storage<Storage> const& src)
+{
+    inner_construct<InnerIterator>(dst, access<inner_range<InnerIterator> >(src).last);
+}
+
+template <typename InnerIterator, typename Storage>
+bool inner_range_empty(range_storage<Storage> const& obj)
+{
+    inner_range<InnerIterator> const& range = access<inner_range<InnerIterator> >(obj);
+    return range.first == range.last;
+}
+
+template <typename InnerIterator, typename Storage>
+size_t inner_range_size(range_storage<Storage> const& obj)
+{
+    inner_range<InnerIterator> const& range = access<inner_range<InnerIterator> >(obj);
+    return static_cast<size_t>(std::distance(range.first, range.last));
+}
+
+template <typename ValueType, typename InnerIterator, typename Storage, typename Reference>
+typename std::enable_if<has_contiguous_data<ValueType, InnerIterator> && std::is_same<Reference, ValueType&>::value, ValueType*>::type inner_range_data(range_storage<Storage> const& obj)
+{
+    return inner_to_address(access<inner_range<InnerIterator> >(obj).first);
+}
+
+template <typename ValueType, typename InnerIterator, typename Storage, typename Reference>
+typename std::enable_if<!(has_contiguous_data<ValueType, InnerIterator> && std::is_same<Reference, ValueType&>::value), ValueType*>::type inner_range_data(range_storage<Storage> const&)
+{
+    return nullptr;
+}
+
+template <typename ValueType, typename Category, typename InnerIterator, typename Storage, typename Reference>
+any_range_ops<ValueType, Category, Storage, Reference> const* make_inner_range_ops()
+{
+    static any_range_ops<ValueType, Category, Storage, Reference> const instance
+    (
+        make_inner_iterator_ops<ValueType, InnerIterator, Storage, Reference>(),
+
+        &inner_copy<inner_range<InnerIterator>, range_storage<Storage> >,
+        make_inner_move<inner_range<InnerIterator>, range_storage<Storage> >(),
+        &inner_destroy<inner_range<InnerIterator>, range_storage<Storage> >,
+
+        &inner_range_begin<InnerIterator, Storage>,
+        &inner_range_end<InnerIterator, Storage>,
+        &inner_range_empty<InnerIterator, Storage>,
+        &inner_range_size<InnerIterator, Storage>,
+        &inner_range_data<ValueType, InnerIterator, Storage, Reference>
+    );
+
+    return &instance;
+}
+
+// Type-erased [first, last) pair sharing one ops table and one storage
+// block. size() is O(1) for random access inner iterators, data() returns
+// the first element of contiguous ranges and null otherwise or if Reference
+// is not ValueType&.
+template <typename ValueType, typename Category, typename Storage, typename Reference>
+struct any_range
+{
+    using iterator = any_iterator<ValueType, Category, Storage, Reference>;
+    using const_iterator = iterator;
+    using value_type = ValueType;
+    using reference = Reference;
+    using size_type = size_t;
+    using difference_type = std::ptrdiff_t;
+
+    any_range() noexcept
+        : ops(make_null_range_ops<ValueType, Category, Storage, Reference>())
+    {}
+
+    template <typename InnerIterator>
+    any_range(InnerIterator first, InnerIterator last,
+              typename std::enable_if<
+                  std::is_convertible<typename std::iterator_traits<InnerIterator>::iterator_category*, Category*>::value
+               && !is_any_iterator<InnerIterator, ValueType, Storage, Reference>::value
+              >::type* = nullptr)
+        : ops(make_inner_range_ops<ValueType, Category, InnerIterator, Storage, Reference>())
+    {
+        inner_construct<inner_range<InnerIterator> >(stg, inner_range<InnerIterator>{std::move(first), std::move(last)});
+    }
+
+    template <typename Range>
+    any_range(Range& range,
+              typename std::enable_if<
+                  !std::is_same<typename std::remove_cv<Range>::type, any_range>::value
+              >::type* = nullptr)
+        : any_range(std::begin(range), std::end(range))
+    {}
+
+    any_range(any_range const& other)
+        : ops(other.ops)
+    {
+        ops->copy(stg, other.stg);
+    }
+
+    any_range(any_range&& other) noexcept
+        : ops(other.ops)
+    {
+        move_storage(ops->move, stg, other.stg);
+        other.ops = make_null_range_ops<ValueType, Category, Storage, Reference>();
+    }
+
+    ~any_range()
+    {
+        ops->destroy(stg);
+    }
+
+    any_range& operator=(any_range const& rhs)
+    {
+        if (this != &rhs)
+            *this = any_range(rhs);
+        return *this;
+    }
+
+    any_range& operator=(any_range&& rhs) noexcept
+    {
+        if (this != &rhs)
+        {
+            ops->destroy(stg);
+            ops = rhs.ops;
+            move_storage(ops->move, stg, rhs.stg);
+            rhs.ops = make_null_range_ops<ValueType, Category, Storage, Reference>();
+        }
+        return *this;
+    }
+
+    iterator begin() const
+    {
+        iterator result;
+        ops->begin(result.stg, stg);
+        result.set_ops(ops->iterator_ops);
+        return result;
+    }
+
+    iterator end() const
+    {
+        iterator result;
+        ops->end(result.stg, stg);
+        result.set_ops(ops->iterator_ops);
+        return result;
+    }
+
+    bool empty() const
+    {
+        return ops->empty(stg);
+    }
+
+    size_t size() const
+    {
+        return ops->size(stg);
+    }
+
+    ValueType* data() const
+    {
+        return ops->data(stg);
+    }
+
+    // Calls f(Reference) for every element. Contiguous ranges are walked
+    // with a plain pointer loop, others are fetched in batches, ranges
+    // with other references go through the iterators.
+    template <typename F>
+    F for_each(F f) const
+    {
+        if constexpr (std::is_same<Reference, ValueType&>::value)
+        {
+            if (ValueType* p = data())
+                return std::for_each(p, p + size(), std::move(f));
+
+            for_each_chunk(begin(), end(), [&f](ValueType* const* chunk, size_t n)
+            {
+                for (size_t i = 0; i != n; ++i)
+                    f(*chunk[i]);
+            });
+            return f;
+        }
+        else
+            return std::for_each(begin(), end(), std::move(f));
+    }
+
+private:
+    any_range_ops<ValueType, Category, Storage, Reference> const* ops;
+    range_storage<Storage> stg;
+};
+
+// Category of a single pass inner iterator. C++20 move-only iterators
+// usually have no iterator_traits as they can't be Cpp17 iterators, for
+// them the iterator_concept member is used.
+template <typename InnerIterator, typename = void>
+struct iterator_concept_of
+{};
+
+template <typename InnerIterator>
+struct iterator_concept_of<InnerIterator, std::void_t<typename InnerIterator::iterator_concept> >
+{
+    using type = typename InnerIterator::iterator_concept;
+};
+
+template <typename InnerIterator, typename = void>
+struct single_pass_category : iterator_concept_of<InnerIterator>
+{};
+
+template <typename InnerIterator>
+struct single_pass_category<InnerIterator, std::void_t<typename std::iterator_traits<InnerIterator>::iterator_category> >
+{
+    using type = typename std::iterator_traits<InnerIterator>::iterator_category;
+};
+
+template <typename InnerIterator, typename = void>
+struct is_single_pass_iterator
+{
+    static constexpr bool value = false;
+};
+
+template <typename InnerIterator>
+struct is_single_pass_iterator<InnerIterator, std::void_t<typename single_pass_category<InnerIterator>::type> >
+{
+    static constexpr bool value = std::is_convertible<typename single_pass_category<InnerIterator>::type*, std::input_iterator_tag*>::value
+                               && std::is_move_constructible<InnerIterator>::value;
+};
+
+// Single pass iterators have a reduced ops table: they are move-only, so
+// there is no copy, assign or postinc. An input iterator keeps its end
+// (a sentinel of any type) next to the current position and only knows
+// whether it has reached it, deref returns Reference, which is ValueType
+// for any_input_iterator.
+template <typename ValueType, typename Storage, typename Reference>
+struct any_iterator_ops<ValueType, std::input_iterator_tag, Storage, Reference>
+{
+    // null if the storage can be moved by copying its bytes
+    using move_t = void (*)(Storage& dst, Storage& src);
+    using destroy_t = void (*)(Storage& obj);
+    using deref_t = Reference (*)(Storage const& obj);
+    using preinc_t = void (*)(Storage& obj);
+    using at_end_t = bool (*)(Storage const& obj);
+
+    deref_t deref;
+    preinc_t preinc;
+    at_end_t at_end;
+
+    std::type_info const* type;
+
+    move_t move;
+    destroy_t destroy;
+
+    constexpr any_iterator_ops(std::type_info const* type,
+                               move_t move, destroy_t destroy,
+                               deref_t deref, preinc_t preinc, at_end_t at_end)
+        : deref(deref)
+        , preinc(preinc)
+        , at_end(at_end)
+        , type(type)
+        , move(move)
+        , destroy(destroy)
+    {}
+};
+
+// An output iterator is advanced by every put, as *it++ = value would do.
+// There is no dereference, so Reference is ignored.
+template <typename ValueType, typename Storage, typename Reference>
+struct any_iterator_ops<ValueType, std::output_iterator_tag, Storage, Reference>
+{
+    // null if the storage can be moved by copying its bytes
+    using move_t = void (*)(Storage& dst, Storage& src);
+    using destroy_t = void (*)(Storage& obj);
+    using put_t = void (*)(Storage& obj, ValueType const& value);
+    using put_move_t = void (*)(Storage& obj, ValueType&& value);
+
+    put_t put;
+    put_move_t put_move;
+
+    std::type_info const* type;
+
+    move_t move;
+    destroy_t destroy;
+
+    constexpr any_iterator_ops(std::type_info const* type,
+                               move_t move, destroy_t destroy,
+                               put_t put, put_move_t put_move)
+        : put(put)
+        , put_move(put_move)
+        , type(type)
+        , move(move)
+        , destroy(destroy)
+    {}
+};
+
+template <typename Reference, typename Storage>
+Reference null_input_deref(Storage const&)
+{
+    throw bad_any_iterator();
+}
+
+template <typename Storage>
+bool null_at_end(Storage const&)
+{
+    return true;
+}
+
+template <typename ValueType, typename Storage>
+void null_put(Storage&, ValueType const&)
+{
+    throw bad_any_iterator();
+}
+
+template <typename ValueType, typename Storage>
+void null_put_move(Storage&, ValueType&&)
+{
+    throw bad_any_iterator();
+}
+
+template <typename ValueType, typename Storage, typename Reference>
+inline any_iterator_ops<ValueType, std::input_iterator_tag, Storage, Reference> const* make_null_input_ops()
+{
+    static constexpr any_iterator_ops<ValueType, std::input_iterator_tag, Storage, Reference> instance
+    (
+        &typeid(void),
+        nullptr,
+        &null_destroy<Storage>,
+        &null_input_deref<Reference, Storage>,
+        &null_preinc<Storage>,
+        &null_at_end<Storage>
+    );
+
+    return &instance;
+}
+
+template <typename ValueType, typename Storage>
+inline any_iterator_ops<ValueType, std::output_iterator_tag, Storage, ValueType&> const* make_null_output_ops()
+{
+    static constexpr any_iterator_ops<ValueType, std::output_iterator_tag, Storage, ValueType&> instance
+    (
+        &typeid(void),
+        nullptr,
+        &null_destroy<Storage>,
+        &null_put<ValueType, Storage>,
+        &null_put_move<ValueType, Storage>
+    );
+
+    return &instance;
+}
+
+template <typename Reference, typename InnerRange, typename Storage>
+Reference inner_input_deref(Storage const& obj)
+{
+    return *access<InnerRange>(obj).first;
+}
+
+template <typename InnerRange, typename Storage>
+void inner_input_preinc(Storage& obj)
+{
+    ++access<InnerRange>(obj).first;
+}
+
+template <typename InnerRange, typename Storage>
+bool inner_at_end(Storage const& obj)
+{
+    InnerRange const& range = access<InnerRange>(obj);
+    return range.first == range.last;
+}
+
+template <typename ValueType, typename InnerIterator, typename Storage>
+void inner_put(Storage& obj, ValueType const& value)
+{
+    InnerIterator& it = access<InnerIterator>(obj);
+    *it = value;
+    ++it;
+}
+
+template <typename ValueType, typename InnerIterator, typename Storage>
+void inner_put_move(Storage& obj, ValueType&& value)
+{
+    InnerIterator& it = access<InnerIterator>(obj);
+    *it = std::move(value);
+    ++it;
+}
+
+template <typename ValueType, typename InnerRange, typename Storage, typename Reference>
+any_iterator_ops<ValueType, std::input_iterator_tag, Storage, Reference> const* make_inner_input_ops()
+{
+    static constexpr any_iterator_ops<ValueType, std::input_iterator_tag, Storage, Reference> instance
+    (
+        &typeid(InnerRange),
+        make_inner_move<InnerRange, Storage>(),
+        &inner_destroy<InnerRange, Storage>,
+        &inner_input_deref<Reference, InnerRange, Storage>,
+        &inner_input_preinc<InnerRange, Storage>,
+        &inner_at_end<InnerRange, Storage>
+    );
+
+    return &instance;
+}
+
+template <typename ValueType, typename InnerIterator, typename Storage>
+any_iterator_ops<ValueType, std::output_iterator_tag, Storage, ValueType&> const* make_inner_output_ops()
+{
+    static constexpr any_iterator_ops<ValueType, std::output_iterator_tag, Storage, ValueType&> instance
+    (
+        &typeid(InnerIterator),
+        make_inner_move<InnerIterator, Storage>(),
+        &inner_destroy<InnerIterator, Storage>,
+        &inner_put<ValueType, InnerIterator, Storage>,
+        &inner_put_move<ValueType, InnerIterator, Storage>
+    );
+
+    return &instance;
+}
+
+// Move-only single pass iterator over [first, last) of any input iterator
+// and a sentinel for it. As with std::istream_iterator a default constructed
+// iterator is the end, two iterators compare equal if both are at the end.
+// The ops table has no copy entries, so the inner iterator only needs to be
+// movable: move-only iterators holding a buffer or a handle are taken as is.
+template <typename ValueType, typename Storage, typename Reference>
+struct any_iterator<ValueType, std::input_iterator_tag, Storage, Reference>
+{
+    using value_type = ValueType;
+    using iterator_category = std::input_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = Reference;
+
+    any_iterator() noexcept
+        : ops(make_null_input_ops<ValueType, Storage, Reference>())
+    {}
+
+    template <typename InnerIterator, typename Sentinel>
+    any_iterator(InnerIterator first, Sentinel last,
+                 typename std::enable_if<
+                     is_single_pass_iterator<InnerIterator>::value
+                 >::type* = nullptr)
+        : ops(make_inner_input_ops<ValueType, inner_range<InnerIterator, Sentinel>, Storage, Reference>())
+    {
+        static_assert(is_reference_compatible<decltype(*std::declval<InnerIterator&>()), Reference>::value,
+                      "the inner iterator's reference doesn't convert to Reference; "
+                      "iterators returning elements by value need a by-value Reference");
+        inner_construct<inner_range<InnerIterator, Sentinel> >(stg, inner_range<InnerIterator, Sentinel>{std::move(first), std::move(last)});
+    }
+
+    any_iterator(any_iterator&& other) noexcept
+        : ops(other.ops)
+    {
+        ANY_ITERATOR_STATS_OP(move);
+        move_storage(ops->move, stg, other.stg);
+        other.ops = make_null_input_ops<ValueType, Storage, Reference>();
+    }
+
+    any_iterator& operator=(any_iterator&& rhs) noexcept
+    {
+        if (this != &rhs)
+        {
+            ANY_ITERATOR_STATS_OP(move);
+            ops->destroy(stg);
+            move_storage(rhs.ops->move, stg, rhs.stg);
+            ops = rhs.ops;
+            rhs.ops = make_null_input_ops<ValueType, Storage, Reference>();
+        }
+        return *this;
+    }
+
+    ~any_iterator()
+    {
+        ANY_ITERATOR_STATS_OP(destroy);
+        ops->destroy(stg);
+    }
+
+    Reference operator*() const
+    {
+        ANY_ITERATOR_STATS_OP(deref);
+        return ops->deref(stg);
+    }
+
+    any_iterator& operator++()
+    {
+        ANY_ITERATOR_STATS_OP(preinc);
+        ops->preinc(stg);
+        return *this;
+    }
+
+    void operator++(int)
+    {
+        ++*this;
+    }
+
+    bool at_end() const
+    {
+        ANY_ITERATOR_STATS_OP(at_end);
+        return ops->at_end(stg);
+    }
+
+    std::type_info const& target_type() const noexcept
+    {
+        return *ops->type;
+    }
+
+    friend bool operator==(any_iterator const& lhs, any_iterator const& rhs)
+    {
+        return lhs.at_end() == rhs.at_end();
+    }
+
+    friend bool operator!=(any_iterator const& lhs, any_iterator const& rhs)
+    {
+        return !(lhs == rhs);
+    }
+
+#if defined(__cpp_lib_concepts)
+    friend bool operator==(any_iterator const& it, std::default_sentinel_t)
+    {
+        return it.at_end();
+    }
+#endif
+
+private:
+    any_iterator_ops<ValueType, std::input_iterator_tag, Storage, Reference> const* ops;
+    Storage stg;
+};
+
+// Move-only sink writing to any iterator that ValueType can be assigned
+// through. *it = value writes and advances the inner iterator, ++ does
+// nothing.
+template <typename ValueType, typename Storage, typename Reference>
+struct any_iterator<ValueType, std::output_iterator_tag, Storage, Reference>
+{
+    using value_type = void;
+    using iterator_category = std::output_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = void;
+
+    any_iterator() noexcept
+        : ops(make_null_output_ops<ValueType, Storage>())
+    {}
+
+    template <typename InnerIterator>
+    any_iterator(InnerIterator it,
+                 typename std::enable_if<
+                     !std::is_same<InnerIterator, any_iterator>::value
+                  && std::is_assignable<decltype(*std::declval<InnerIterator&>()), ValueType const&>::value
+                 >::type* = nullptr)
+        : ops(make_inner_output_ops<ValueType, InnerIterator, Storage>())
+    {
+        inner_construct<InnerIterator>(stg, std::move(it));
+    }
+
+    any_iterator(any_iterator&& other) noexcept
+        : ops(other.ops)
+    {
+        ANY_ITERATOR_STATS_OP(move);
+        move_storage(ops->move, stg, other.stg);
+        other.ops = make_null_output_ops<ValueType, Storage>();
+    }
+
+    any_iterator& operator=(any_iterator&& rhs) noexcept
+    {
+        if (this != &rhs)
+        {
+            ANY_ITERATOR_STATS_OP(move);
+            ops->destroy(stg);
+            move_storage(rhs.ops->move, stg, rhs.stg);
+            ops = rhs.ops;
+            rhs.ops = make_null_output_ops<ValueType, Storage>();
+        }
+        return *this;
+    }
+
+    ~any_iterator()
+    {
+        ANY_ITERATOR_STATS_OP(destroy);
+        ops->destroy(stg);
+    }
+
+    any_iterator& operator=(ValueType const& value)
+    {
+        ANY_ITERATOR_STATS_OP(put);
+        ops->put(stg, value);
+        return *this;
+    }
+
+    any_iterator& operator=(ValueType&& value)
+    {
+        ANY_ITERATOR_STATS_OP(put);
+        ops->put_move(stg, std::move(value));
+        return *this;
+    }
+
+    any_iterator& operator*() noexcept
+    {
+        return *this;
+    }
+
+    any_iterator& operator++() noexcept
+    {
+        return *this;
+    }
+
+    any_iterator& operator++(int) noexcept
+    {
+        return *this;
+    }
+
+    std::type_info const& target_type() const noexcept
+    {
+        return *ops->type;
+    }
+
+private:
+    any_iterator_ops<ValueType, std::output_iterator_tag, Storage, ValueType&> const* ops;
+    Storage stg;
+};
+
+}
+
+using any_iterator_impl::bad_any_iterator;
+using any_iterator_impl::any_iterator;
+
+using any_iterator_impl::inline_storage;
+using any_iterator_impl::default_storage;
+using any_iterator_impl::hot_ops_storage;
+using any_iterator_impl::pooled_allocator;
+using any_iterator_impl::pooled_storage;
+using any_iterator_impl::shared_storage;
+using any_iterator_impl::relocatable_storage;
+using any_iterator_impl::for_each_chunk;
+using any_iterator_impl::for_each_prefetched;
+using any_iterator_impl::any_range;
+using any_iterator_impl::is_trivially_relocatable;
+using any_iterator_impl::relocate;
+using any_iterator_impl::any_sentinel;
+using any_iterator_impl::null_sentinel;
+
+template <typename ValueType, typename Storage = default_storage, typename Reference = ValueType&>
+using any_forward_iterator = any_iterator<ValueType, std::forward_iterator_tag, Storage, Reference>;
+
+template <typename ValueType, typename Storage = default_storage, typename Reference = ValueType&>
+using any_bidirectional_iterator = any_iterator<ValueType, std::bidirectional_iterator_tag, Storage, Reference>;
+
+template <typename ValueType, typename Storage = default_storage, typename Reference = ValueType&>
+using any_random_access_iterator = any_iterator<ValueType, std::random_access_iterator_tag, Storage, Reference>;
+
+template <typename ValueType, typename Storage = default_storage, typename Reference = ValueType>
+using any_input_iterator = any_iterator<ValueType, std::input_iterator_tag, Storage, Reference>;
+
+template <typename ValueType, typename Storage = default_storage>
+using any_output_iterator = any_iterator<ValueType, std::output_iterator_tag, Storage>;
+
+#if defined(__cpp_lib_concepts)
+template <typename ValueType>
+using any_contiguous_iterator = any_iterator<ValueType, std::contiguous_iterator_tag>;
+#endif
+
+template <typename ValueType, typename Storage = default_storage, typename Reference = ValueType&>
+using any_forward_range = any_range<ValueType, std::forward_iterator_tag, Storage, Reference>;
+
+template <typename ValueType, typename Storage = default_storage, typename Reference = ValueType&>
+using any_bidirectional_range = any_range<ValueType, std::bidirectional_iterator_tag, Storage, Reference>;
+
+template <typename ValueType, typename Storage = default_storage, typename Reference = ValueType&>
+using any_random_access_range = any_range<ValueType, std::random_access_iterator_tag, Storage, Reference>;
+
+#if defined(ANY_ITERATOR_EXTERN_TEMPLATES)
+#include "any_iterator_instances.h"
+#endif
@@ -0,0 +1,10 @@
+#define ANY_ITERATOR_DEFINE_INSTANCES
+#include "any_iterator_instances.h"
+
+ANY_ITERATOR_INSTANCES(template)
+
+#undef ANY_ITERATOR_INSTANCE_OPS
+#undef ANY_ITERATOR_INSTANCE_CONTAINER_OPS
+#undef ANY_ITERATOR_INSTANCE
+#undef ANY_ITERATOR_INSTANCES
+#undef ANY_ITERATOR_DEFINE_INSTANCES
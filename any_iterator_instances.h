@@ -0,0 +1,58 @@
+#pragma once
+
+#include <deque>
+#include <forward_list>
+#include <iterator>
+#include <list>
+#include <string>
+#include <vector>
+#include "any_iterator.h"
+
+// Explicit instantiations of any_iterator and of the ops tables for the
+// common value types and the iterators of the standard containers.
+// any_iterator_instances.cpp defines them once (the any_iterator_instances
+// library). With ANY_ITERATOR_EXTERN_TEMPLATES defined they are declared
+// extern here, so translation units including any_iterator.h link against
+// the library instead of instantiating the tables and the inner_* functions
+// behind them again. The library has to be built with the same
+// ANY_ITERATOR_STATS setting as its users. The helper macros are undefined
+// at the end of this header unless ANY_ITERATOR_DEFINE_INSTANCES is defined,
+// as it is by any_iterator_instances.cpp.
+#define ANY_ITERATOR_INSTANCE_OPS(prefix, T, InnerIterator) \
+    prefix ::any_iterator_impl::erased_ops<T, std::iterator_traits<InnerIterator>::iterator_category, ::any_iterator_impl::default_storage, T&> const* \
+        ::any_iterator_impl::make_inner_iterator_ops<T, InnerIterator, ::any_iterator_impl::default_storage, T&>();
+
+#define ANY_ITERATOR_INSTANCE_CONTAINER_OPS(prefix, T, Container) \
+    ANY_ITERATOR_INSTANCE_OPS(prefix, T, Container<T>::iterator) \
+    ANY_ITERATOR_INSTANCE_OPS(prefix, T, Container<T>::const_iterator)
+
+#define ANY_ITERATOR_INSTANCE(prefix, T) \
+    prefix struct ::any_iterator_impl::any_iterator<T, std::forward_iterator_tag>; \
+    prefix struct ::any_iterator_impl::any_iterator<T, std::bidirectional_iterator_tag>; \
+    prefix struct ::any_iterator_impl::any_iterator<T, std::random_access_iterator_tag>; \
+    ANY_ITERATOR_INSTANCE_OPS(prefix, T, T*) \
+    ANY_ITERATOR_INSTANCE_OPS(prefix, T, T const*) \
+    ANY_ITERATOR_INSTANCE_CONTAINER_OPS(prefix, T, std::vector) \
+    ANY_ITERATOR_INSTANCE_CONTAINER_OPS(prefix, T, std::deque) \
+    ANY_ITERATOR_INSTANCE_CONTAINER_OPS(prefix, T, std::list) \
+    ANY_ITERATOR_INSTANCE_CONTAINER_OPS(prefix, T, std::forward_list)
+
+#define ANY_ITERATOR_INSTANCES(prefix) \
+    ANY_ITERATOR_INSTANCE(prefix, int) \
+    ANY_ITERATOR_INSTANCE(prefix, unsigned) \
+    ANY_ITERATOR_INSTANCE(prefix, long) \
+    ANY_ITERATOR_INSTANCE(prefix, char) \
+    ANY_ITERATOR_INSTANCE(prefix, float) \
+    ANY_ITERATOR_INSTANCE(prefix, double) \
+    ANY_ITERATOR_INSTANCE(prefix, std::string)
+
+#if defined(ANY_ITERATOR_EXTERN_TEMPLATES)
+ANY_ITERATOR_INSTANCES(extern template)
+#endif
+
+#if !defined(ANY_ITERATOR_DEFINE_INSTANCES)
+#undef ANY_ITERATOR_INSTANCE_OPS
+#undef ANY_ITERATOR_INSTANCE_CONTAINER_OPS
+#undef ANY_ITERATOR_INSTANCE
+#undef ANY_ITERATOR_INSTANCES
+#endif
@@ -0,0 +1,511 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "any_iterator.h"
+
+// Parallel versions of for_each, transform, reduce, sort and find for random
+// access any_iterators. The range is split into chunks with += and -, the
+// chunks run on a work-stealing thread pool. A chunk of a contiguous inner
+// iterator runs on raw pointers and a chunk of a std::deque on deque
+// iterators, other chunks dispatch every element through the ops table.
+namespace any_iterator_impl
+{
+namespace parallel
+{
+constexpr size_t default_grain = 4096;
+
+// Every worker owns a queue: it pushes and pops at the back of its own queue
+// and steals from the front of the others when it runs out of work. Threads
+// waiting for a group of tasks run pending tasks meanwhile, so algorithms
+// can be nested and the pool can be used from its own workers.
+class thread_pool
+{
+public:
+    explicit thread_pool(size_t number_of_threads = std::max<size_t>(1, std::thread::hardware_concurrency()),
+                         size_t grain = default_grain)
+        : grain_(grain)
+        , pending(0)
+        , next_queue(0)
+        , stop(false)
+    {
+        for (size_t i = 0; i != number_of_threads; ++i)
+            queues.push_back(std::make_unique<worker_queue>());
+        for (size_t i = 0; i != number_of_threads; ++i)
+            threads.emplace_back([this, i] { work(i); });
+    }
+
+    thread_pool(thread_pool const&) = delete;
+    thread_pool& operator=(thread_pool const&) = delete;
+
+    ~thread_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lg(mutex);
+            stop = true;
+        }
+        cv.notify_all();
+        for (std::thread& t : threads)
+            t.join();
+    }
+
+    size_t size() const noexcept
+    {
+        return threads.size();
+    }
+
+    // ranges shorter than this run on the calling thread
+    size_t grain() const noexcept
+    {
+        return grain_;
+    }
+
+    void submit(std::function<void()> task)
+    {
+        size_t index = current_pool() == this ? current_index() : next_queue++ % queues.size();
+        {
+            std::lock_guard<std::mutex> lg(mutex);
+            ++pending;
+        }
+        try
+        {
+            std::lock_guard<std::mutex> lg(queues[index]->mutex);
+            queues[index]->tasks.push_back(std::move(task));
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lg(mutex);
+            --pending;
+            throw;
+        }
+        cv.notify_one();
+    }
+
+    // runs one pending task on the calling thread, false if there was none
+    bool run_pending_task()
+    {
+        std::function<void()> task;
+        if (!pop(current_pool() == this ? current_index() : 0, task))
+            return false;
+        task();
+        return true;
+    }
+
+private:
+    struct worker_queue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()> > tasks;
+    };
+
+    static thread_pool*& current_pool() noexcept
+    {
+        static thread_local thread_pool* pool = nullptr;
+        return pool;
+    }
+
+    static size_t& current_index() noexcept
+    {
+        static thread_local size_t index = 0;
+        return index;
+    }
+
+    bool pop(size_t self, std::function<void()>& task)
+    {
+        for (size_t i = 0; i != queues.size(); ++i)
+        {
+            worker_queue& q = *queues[(self + i) % queues.size()];
+            std::lock_guard<std::mutex> lg(q.mutex);
+            if (q.tasks.empty())
+                continue;
+            if (i == 0)
+            {
+                task = std::move(q.tasks.back());
+                q.tasks.pop_back();
+            }
+            else
+            {
+                task = std::move(q.tasks.front());
+                q.tasks.pop_front();
+            }
+            --pending;
+            return true;
+        }
+        return false;
+    }
+
+    void work(size_t index)
+    {
+        current_pool() = this;
+        current_index() = index;
+
+        std::function<void()> task;
+        for (;;)
+        {
+            if (pop(index, task))
+            {
+                task();
+                task = nullptr;
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lg(mutex);
+            cv.wait(lg, [this] { return stop || pending != 0; });
+            if (stop && pending == 0)
+                return;
+        }
+    }
+
+    size_t grain_;
+    std::vector<std::unique_ptr<worker_queue> > queues;
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::atomic<size_t> pending;
+    std::atomic<size_t> next_queue;
+    bool stop;
+};
+
+inline thread_pool& default_pool()
+{
+    static thread_pool instance;
+    return instance;
+}
+
+// Number of chunks [0, n) is split into: several per thread for load
+// balancing, none shorter than the grain of the pool.
+inline size_t number_of_chunks(thread_pool& pool, size_t n)
+{
+    return std::max<size_t>(1, std::min(n / std::max<size_t>(1, pool.grain()), 4 * (pool.size() + 1)));
+}
+
+inline size_t chunk_begin(size_t n, size_t chunks, size_t i)
+{
+    return n / chunks * i + std::min(i, n % chunks);
+}
+
+// Calls f(i) for every i in [0, chunks) on the pool and waits for all calls
+// to finish, running pending tasks meanwhile. The first exception thrown by
+// f is rethrown.
+template <typename F>
+void run_chunks(thread_pool& pool, size_t chunks, F const& f)
+{
+    struct group
+    {
+        std::atomic<size_t> remaining;
+        std::mutex mutex;
+        std::exception_ptr error;
+    } g;
+    g.remaining = chunks;
+
+    auto run = [&g, &f](size_t i)
+    {
+        try
+        {
+            f(i);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lg(g.mutex);
+            if (!g.error)
+                g.error = std::current_exception();
+        }
+        --g.remaining;
+    };
+
+    auto wait = [&g, &pool]
+    {
+        while (g.remaining != 0)
+            if (!pool.run_pending_task())
+                std::this_thread::yield();
+    };
+
+    size_t submitted = 1;
+    try
+    {
+        for (; submitted < chunks; ++submitted)
+            pool.submit([&run, i = submitted] { run(i); });
+    }
+    catch (...)
+    {
+        // the queued tasks refer to this frame, they finish before it unwinds;
+        // neither the chunks that weren't submitted nor chunk 0 will run
+        g.remaining -= chunks - submitted + 1;
+        wait();
+        throw;
+    }
+    if (chunks != 0)
+        run(0);
+
+    wait();
+
+    if (g.error)
+        std::rethrow_exception(g.error);
+}
+
+// The chunk iterators are copied, advanced and destroyed on the workers, so
+// inner iterators shared between copies need an atomic reference count.
+template <typename Counter>
+struct is_thread_safe_counter : std::is_void<Counter>
+{};
+
+template <typename T>
+struct is_thread_safe_counter<std::atomic<T> > : std::true_type
+{};
+
+template <typename Storage>
+constexpr bool shareable_across_threads = is_thread_safe_counter<typename Storage::shared_counter>::value;
+
+// Calls g with the iterator the chunks of a range starting at first are
+// walked with: a pointer for contiguous inner iterators and the inner
+// iterator itself for std::deque, so that those chunks run without
+// dispatch. Chunks of other inner iterators are any_iterators and pay an
+// indirect call per element.
+template <typename ValueType, typename Storage, typename G>
+void with_chunk_iterator(any_iterator<ValueType, std::random_access_iterator_tag, Storage> const& first, G const& g)
+{
+    using deque = std::deque<typename std::remove_cv<ValueType>::type>;
+    using deque_iterator = typename std::conditional<std::is_const<ValueType>::value,
+                                                     typename deque::const_iterator, typename deque::iterator>::type;
+
+    if (ValueType* data = first.contiguous_data())
+        return g(data);
+    if (auto it = first.template target<typename deque::iterator>())
+        return g(deque_iterator(*it));
+    if constexpr (std::is_const<ValueType>::value)
+    {
+        if (auto it = first.template target<typename deque::const_iterator>())
+            return g(deque_iterator(*it));
+    }
+    g(first);
+}
+
+// Calls f(i, offset, chunk_first, chunk_last) for the chunks of
+// [first, last) in parallel, where i is the index of the chunk and offset
+// its distance from first. The chunks are of the iterator type
+// with_chunk_iterator picks.
+template <typename ValueType, typename Storage, typename F>
+void for_each_subrange(thread_pool& pool,
+                       any_iterator<ValueType, std::random_access_iterator_tag, Storage> const& first,
+                       any_iterator<ValueType, std::random_access_iterator_tag, Storage> const& last,
+                       F const& f)
+{
+    static_assert(shareable_across_threads<Storage>, "the reference count of a shared_storage must be a std::atomic to be used by the workers");
+
+    size_t n = last - first;
+    size_t chunks = number_of_chunks(pool, n);
+    with_chunk_iterator(first, [&](auto const& chunk_first)
+    {
+        run_chunks(pool, chunks, [&](size_t i)
+        {
+            std::ptrdiff_t begin = chunk_begin(n, chunks, i), end = chunk_begin(n, chunks, i + 1);
+            f(i, static_cast<size_t>(begin), chunk_first + begin, chunk_first + end);
+        });
+    });
+}
+
+template <typename ValueType, typename Storage, typename F>
+void for_each(thread_pool& pool,
+              any_iterator<ValueType, std::random_access_iterator_tag, Storage> const& first,
+              any_iterator<ValueType, std::random_access_iterator_tag, Storage> const& last,
+              F f)
+{
+    for_each_subrange(pool, first, last, [&f](size_t, size_t, auto chunk_first, auto chunk_last)
+    {
+        std::for_each(chunk_first, chunk_last, f);
+    });
+}
+
+// Writes f(x) for every x of [first, last) to the random access range that
+// starts at out, returns the end of the written range.
+template <typename ValueType, typename Storage, typename OutputIterator, typename F>
+OutputIterator transform(thread_pool& pool,
+                         any_iterator<ValueType, std::random_access_iterator_tag, Storage> const& first,
+                         any_iterator<ValueType, std::random_access_iterator_tag, Storage> const& last,
+                         OutputIterator out, F f)
+{
+    for_each_subrange(pool, first, last, [&](size_t, size_t offset, auto chunk_first, auto chunk_last)
+    {
+        std::transform(chunk_first, chunk_last, std::next(out, offset), f);
+    });
+    return std::next(std::move(out), last - first);
+}
+
+template <typename ValueType, typename OutputStorage, typename Storage, typename F>
+any_iterator<ValueType, std::random_access_iterator_tag, OutputStorage> transform(
+        thread_pool& pool,
+        any_iterator<ValueType, std::random_access_iterator_tag, Storage> const& first,
+        any_iterator<ValueType, std::random_access_iterator_tag, Storage> const& last,
+        any_iterator<ValueType, std::random_access_iterator_tag, OutputStorage> out, F f)
+{
+    static_assert(shareable_across_threads<OutputStorage>, "the reference count of a shared_storage must be a std::atomic to be used by the workers");
+
+    ValueType* data = out.contiguous_data();
+    for_each_subrange(pool, first, last, [&](size_t, size_t offset, auto chunk_first, auto chunk_last)
+    {
+        if (data)
+            std::transform(chunk_first, chunk_last, data + offset, f);
+        else
+            std::transform(chunk_first, chunk_last, out + offset, f);
+    });
+    out += last - first;
+    return out;
+}
+
+// Like std::reduce: op must be associative and commutative, the elements are
+// combined in an unspecified order.
+template <typename ValueType, typename Storage, typename T, typename BinaryOperation = std::plus<> >
+T reduce(thread_pool& pool,
+         any_iterator<ValueType, std::random_access_iterator_tag, Storage> const& first,
+         any_iterator<ValueType, std::random_access_iterator_tag, Storage> const& last,
+         T init, BinaryOperation op = BinaryOperation())
+{
+    std::vector<T> partial(number_of_chunks(pool, last - first), init);
+    std::vector<char> nonempty(partial.size());
+    for_each_subrange(pool, first, last, [&](size_t i, size_t, auto chunk_first, auto chunk_last)
+    {
+        if (chunk_first == chunk_last)
+            return;
+        T sum = *chunk_first;
+        for (++chunk_first; chunk_first != chunk_last; ++chunk_first)
+            sum = op(std::move(sum), *chunk_first);
+        partial[i] = std::move(sum);
+        nonempty[i] = true;
+    });
+
+    for (size_t i = 0; i != partial.size(); ++i)
+        if (nonempty[i])
+            init = op(std::move(init), std::move(partial[i]));
+    return init;
+}
+
+// Returns the first element equal to value, chunks that start after an
+// already found element stop early.
+template <typename ValueType, typename Storage, typename T>
+any_iterator<ValueType, std::random_access_iterator_tag, Storage> find(
+        thread_pool& pool,
+        any_iterator<ValueType, std::random_access_iterator_tag, Storage> const& first,
+        any_iterator<ValueType, std::random_access_iterator_tag, Storage> const& last,
+        T const& value)
+{
+    constexpr size_t check_interval = 1024;
+
+    size_t n = last - first;
+    std::atomic<size_t> found(n);
+    for_each_subrange(pool, first, last, [&](size_t, size_t offset, auto chunk_first, auto chunk_last)
+    {
+        for (size_t k = 0; chunk_first != chunk_last; ++chunk_first, ++k)
+        {
+            if (k % check_interval == 0 && found.load(std::memory_order_relaxed) < offset)
+                return;
+            if (*chunk_first == value)
+            {
+                size_t index = offset + k;
+                size_t current = found.load();
+                while (index < current && !found.compare_exchange_weak(current, index))
+                {}
+                return;
+            }
+        }
+    });
+    return first + found.load();
+}
+
+// Sorts the chunks in parallel and merges neighbouring sorted runs pairwise,
+// each level of merges runs in parallel too.
+template <typename Iterator, typename Compare>
+void chunked_sort(thread_pool& pool, Iterator first, size_t n, size_t chunks, Compare const& comp)
+{
+    run_chunks(pool, chunks, [&](size_t i)
+    {
+        std::sort(first + chunk_begin(n, chunks, i), first + chunk_begin(n, chunks, i + 1), comp);
+    });
+
+    for (size_t width = 1; width < chunks; width *= 2)
+    {
+        size_t merges = (chunks + 2 * width - 1) / (2 * width);
+        run_chunks(pool, merges, [&](size_t i)
+        {
+            size_t lo = 2 * width * i;
+            size_t mid = std::min(lo + width, chunks);
+            size_t hi = std::min(lo + 2 * width, chunks);
+            if (mid == hi)
+                return;
+            std::inplace_merge(first + chunk_begin(n, chunks, lo),
+                               first + chunk_begin(n, chunks, mid),
+                               first + chunk_begin(n, chunks, hi), comp);
+        });
+    }
+}
+
+template <typename ValueType, typename Storage, typename Compare = std::less<> >
+void sort(thread_pool& pool,
+          any_iterator<ValueType, std::random_access_iterator_tag, Storage> const& first,
+          any_iterator<ValueType, std::random_access_iterator_tag, Storage> const& last,
+          Compare comp = Compare())
+{
+    static_assert(shareable_across_threads<Storage>, "the reference count of a shared_storage must be a std::atomic to be used by the workers");
+
+    size_t n = last - first;
+    size_t chunks = number_of_chunks(pool, n);
+    with_chunk_iterator(first, [&](auto const& chunk_first)
+    {
+        chunked_sort(pool, chunk_first, n, chunks, comp);
+    });
+}
+
+// The same algorithms on the default pool, which has a thread per core.
+template <typename ValueType, typename Storage, typename F>
+void for_each(any_iterator<ValueType, std::random_access_iterator_tag, Storage> const& first,
+              any_iterator<ValueType, std::random_access_iterator_tag, Storage> const& last,
+              F f)
+{
+    parallel::for_each(default_pool(), first, last, std::move(f));
+}
+
+template <typename ValueType, typename Storage, typename OutputIterator, typename F>
+OutputIterator transform(any_iterator<ValueType, std::random_access_iterator_tag, Storage> const& first,
+                         any_iterator<ValueType, std::random_access_iterator_tag, Storage> const& last,
+                         OutputIterator out, F f)
+{
+    return parallel::transform(default_pool(), first, last, std::move(out), std::move(f));
+}
+
+template <typename ValueType, typename Storage, typename T, typename BinaryOperation = std::plus<> >
+T reduce(any_iterator<ValueType, std::random_access_iterator_tag, Storage> const& first,
+         any_iterator<ValueType, std::random_access_iterator_tag, Storage> const& last,
+         T init, BinaryOperation op = BinaryOperation())
+{
+    return parallel::reduce(default_pool(), first, last, std::move(init), std::move(op));
+}
+
+template <typename ValueType, typename Storage, typename T>
+any_iterator<ValueType, std::random_access_iterator_tag, Storage> find(
+        any_iterator<ValueType, std::random_access_iterator_tag, Storage> const& first,
+        any_iterator<ValueType, std::random_access_iterator_tag, Storage> const& last,
+        T const& value)
+{
+    return parallel::find(default_pool(), first, last, value);
+}
+
+template <typename ValueType, typename Storage, typename Compare = std::less<> >
+void sort(any_iterator<ValueType, std::random_access_iterator_tag, Storage> const& first,
+          any_iterator<ValueType, std::random_access_iterator_tag, Storage> const& last,
+          Compare comp = Compare())
+{
+    parallel::sort(default_pool(), first, last, std::move(comp));
+}
+}
+}
+
+namespace any_iterator_parallel = any_iterator_impl::parallel;
@@ -0,0 +1,365 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include "any_iterator.h"
+
+// Read-ahead for slow sources such as decoders or iterators over cold pages.
+// A producer thread advances the source ahead of the consumer and copies the
+// elements into a lock-free single producer, single consumer ring, so that
+// the consumer only pays a ring read per element while the source works in
+// parallel. The elements are consumed as they are read, so the result is a
+// single pass any_input_iterator. A side that finds the ring full or empty
+// yields for a while and then sleeps until the other side makes progress.
+namespace any_iterator_impl
+{
+namespace readahead
+{
+constexpr size_t default_depth = 256;
+// times a side retries before it sleeps
+constexpr size_t spins_before_parking = 64;
+
+// Fixed capacity ring of up to capacity() elements; one thread pushes, one
+// thread pops. Each side keeps its own position on its own cache line next
+// to a cached copy of the other side's, so the shared positions are only
+// read when the ring looks full or empty.
+template <typename T>
+class spsc_ring
+{
+public:
+    // the capacity is rounded up to a power of two
+    explicit spsc_ring(size_t capacity)
+        : mask(round_up(capacity) - 1)
+        , slots(new slot[mask + 1])
+        , head(0)
+        , cached_tail(0)
+        , tail(0)
+        , cached_head(0)
+    {}
+
+    spsc_ring(spsc_ring const&) = delete;
+    spsc_ring& operator=(spsc_ring const&) = delete;
+
+    ~spsc_ring()
+    {
+        for (size_t i = head.load(); i != tail.load(); ++i)
+            element(i)->~T();
+    }
+
+    size_t capacity() const noexcept
+    {
+        return mask + 1;
+    }
+
+    // producer side: constructs an element from value, false if the ring is
+    // full, in which case value is left alone
+    template <typename U>
+    bool try_push(U&& value)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - cached_head == capacity())
+        {
+            cached_head = head.load(std::memory_order_acquire);
+            if (t - cached_head == capacity())
+                return false;
+        }
+        ::new (static_cast<void*>(element(t))) T(std::forward<U>(value));
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // producer side: whether a push would succeed
+    bool has_room() noexcept
+    {
+        cached_head = head.load(std::memory_order_acquire);
+        return tail.load(std::memory_order_relaxed) - cached_head != capacity();
+    }
+
+    // consumer side: whether a pop would succeed
+    bool has_data() noexcept
+    {
+        cached_tail = tail.load(std::memory_order_acquire);
+        return head.load(std::memory_order_relaxed) != cached_tail;
+    }
+
+    // consumer side: moves the oldest element to out, false if the ring is
+    // empty
+    template <typename Out>
+    bool try_pop(Out& out)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == cached_tail)
+        {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if (h == cached_tail)
+                return false;
+        }
+        T* p = element(h);
+        out = std::move(*p);
+        p->~T();
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    struct slot
+    {
+        alignas(T) unsigned char bytes[sizeof(T)];
+    };
+
+    static size_t round_up(size_t n)
+    {
+        size_t capacity = 1;
+        while (capacity < n)
+            capacity *= 2;
+        return capacity;
+    }
+
+    T* element(size_t i) const noexcept
+    {
+        return std::launder(reinterpret_cast<T*>(slots[i & mask].bytes));
+    }
+
+    size_t mask;
+    std::unique_ptr<slot[]> slots;
+
+    alignas(cache_line_size) std::atomic<size_t> head;
+    size_t cached_tail;
+
+    alignas(cache_line_size) std::atomic<size_t> tail;
+    size_t cached_head;
+};
+
+// Ring and producer thread of one reader. Destroying it cancels the
+// producer and joins it: the producer checks for cancellation after every
+// element and while it waits for room in the ring.
+//
+// A side that gives up spinning sets its parked flag and sleeps on its
+// condition variable; the other side checks the flag after every push or
+// pop and notifies it. The seq_cst fences on both sides order the flag
+// against the ring positions, so either the sleeper sees the progress or
+// the other side sees the flag.
+template <typename T>
+struct state
+{
+    template <typename InnerIterator, typename Sentinel>
+    state(InnerIterator first, Sentinel last, size_t depth)
+        : ring(depth)
+        , done(false)
+        , cancelled(false)
+        , producer_parked(false)
+        , consumer_parked(false)
+    {
+        producer = std::thread([this, first = std::move(first), last = std::move(last)]() mutable
+        {
+            produce(first, last);
+        });
+    }
+
+    state(state const&) = delete;
+    state& operator=(state const&) = delete;
+
+    ~state()
+    {
+        cancelled.store(true, std::memory_order_relaxed);
+        wake(producer_parked, room);
+        producer.join();
+    }
+
+    // Waits on cv until ready() holds, with parked set meanwhile.
+    template <typename Ready>
+    void park(std::atomic<bool>& parked, std::condition_variable& cv, Ready ready)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        parked.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        cv.wait(lock, ready);
+        parked.store(false, std::memory_order_relaxed);
+    }
+
+    // Notifies the other side if it is parked, after a push, a pop or a
+    // change of done or cancelled.
+    void wake(std::atomic<bool>& parked, std::condition_variable& cv)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!parked.load(std::memory_order_relaxed))
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+        }
+        cv.notify_one();
+    }
+
+    // false if cancelled before there was room for value
+    bool push(T& value)
+    {
+        for (size_t spins = 0; !ring.try_push(std::move(value)); ++spins)
+        {
+            if (cancelled.load(std::memory_order_relaxed))
+                return false;
+            if (spins < spins_before_parking)
+                std::this_thread::yield();
+            else
+                park(producer_parked, room, [this] { return ring.has_room() || cancelled.load(std::memory_order_relaxed); });
+        }
+        wake(consumer_parked, data);
+        return true;
+    }
+
+    template <typename InnerIterator, typename Sentinel>
+    void produce(InnerIterator& first, Sentinel& last)
+    {
+        try
+        {
+            for (; !(first == last); ++first)
+            {
+                T value(*first);
+                if (!push(value) || cancelled.load(std::memory_order_relaxed))
+                    break;
+            }
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+        done.store(true, std::memory_order_release);
+        wake(consumer_parked, data);
+    }
+
+    // Waits for the next element and moves it to current, false at the end
+    // of the source. An exception thrown by the source is rethrown here once
+    // the elements read before it have been consumed.
+    bool fetch()
+    {
+        for (size_t spins = 0;; ++spins)
+        {
+            if (ring.try_pop(current))
+            {
+                wake(producer_parked, room);
+                return true;
+            }
+            if (done.load(std::memory_order_acquire))
+            {
+                // the last elements may have been pushed after the first try
+                if (ring.try_pop(current))
+                    return true;
+                if (error)
+                    std::rethrow_exception(std::exchange(error, nullptr));
+                return false;
+            }
+            if (spins < spins_before_parking)
+                std::this_thread::yield();
+            else
+                park(consumer_parked, data, [this] { return ring.has_data() || done.load(std::memory_order_acquire); });
+        }
+    }
+
+    spsc_ring<T> ring;
+    std::optional<T> current;
+    std::atomic<bool> done;
+    std::atomic<bool> cancelled;
+    std::exception_ptr error;
+
+    std::mutex mutex;
+    // the producer waits for room, the consumer for data
+    std::condition_variable room;
+    std::condition_variable data;
+    std::atomic<bool> producer_parked;
+    std::atomic<bool> consumer_parked;
+
+    std::thread producer;
+};
+
+struct reader_end
+{};
+
+// Move-only input iterator over the elements a producer thread reads ahead
+// from [first, last). The source is only touched by the producer thread
+// from construction on.
+template <typename T>
+class reader
+{
+public:
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = T const*;
+    using reference = T const&;
+    using iterator_category = std::input_iterator_tag;
+
+    template <typename InnerIterator, typename Sentinel>
+    reader(InnerIterator first, Sentinel last, size_t depth = default_depth)
+        : s(std::make_unique<state<T> >(std::move(first), std::move(last), depth))
+    {
+        advance();
+    }
+
+    reader(reader&&) noexcept = default;
+    reader& operator=(reader&&) noexcept = default;
+
+    T const& operator*() const
+    {
+        return *s->current;
+    }
+
+    reader& operator++()
+    {
+        advance();
+        return *this;
+    }
+
+    void operator++(int)
+    {
+        advance();
+    }
+
+    friend bool operator==(reader const& it, reader_end)
+    {
+        return !it.s || !it.s->current;
+    }
+
+    friend bool operator!=(reader const& it, reader_end e)
+    {
+        return !(it == e);
+    }
+
+private:
+    void advance()
+    {
+        try
+        {
+            if (!s->fetch())
+                s->current.reset();
+        }
+        catch (...)
+        {
+            s->current.reset();
+            throw;
+        }
+    }
+
+    std::unique_ptr<state<T> > s;
+};
+
+// any_input_iterator over [first, last) with up to depth elements read
+// ahead on a producer thread; it is at the end once the source is.
+template <typename ValueType, typename Storage = default_storage, typename InnerIterator, typename Sentinel>
+any_input_iterator<ValueType, Storage> make_iterator(InnerIterator first, Sentinel last, size_t depth = default_depth)
+{
+    static_assert(!std::is_const<ValueType>::value, "the elements are moved out of the ring");
+    return any_input_iterator<ValueType, Storage>(
+        reader<ValueType>(std::move(first), std::move(last), depth), reader_end());
+}
+}
+}
+
+namespace any_iterator_readahead = any_iterator_impl::readahead;
@@ -0,0 +1,433 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include "any_iterator.h"
+
+// Vectorized sum, min, max, count and find over any_iterators of arithmetic
+// types. Contiguous inner iterators run the kernels on their memory
+// directly, other inner iterators are gathered into blocks on the stack
+// with next_batch first. On x86-64 the kernels use AVX2 if the CPU has it
+// and SSE2 otherwise, other targets get the compiler's generic vectors, and
+// compilers without vector extensions plain loops.
+#if defined(__GNUC__)
+#define ANY_ITERATOR_SIMD_VECTORS 1
+#define ANY_ITERATOR_SIMD_INLINE __attribute__((always_inline)) inline
+#endif
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define ANY_ITERATOR_SIMD_X86 1
+#endif
+
+namespace any_iterator_impl
+{
+namespace simd
+{
+// element types the vector kernels handle, others use the scalar ones
+template <typename T>
+constexpr bool is_vectorizable = (std::is_integral<T>::value && !std::is_same<T, bool>::value)
+                              || std::is_same<T, float>::value
+                              || std::is_same<T, double>::value;
+
+// min and max of an empty range are undefined, find returns n if there is
+// no element equal to value
+template <typename T>
+struct scalar_kernels
+{
+    static T sum(T const* p, size_t n)
+    {
+        T result = T();
+        for (size_t i = 0; i != n; ++i)
+            result += p[i];
+        return result;
+    }
+
+    template <bool Max>
+    static T extremum(T const* p, size_t n)
+    {
+        T result = p[0];
+        for (size_t i = 1; i < n; ++i)
+            if (Max ? result < p[i] : p[i] < result)
+                result = p[i];
+        return result;
+    }
+
+    static T min(T const* p, size_t n)
+    {
+        return extremum<false>(p, n);
+    }
+
+    static T max(T const* p, size_t n)
+    {
+        return extremum<true>(p, n);
+    }
+
+    static size_t count(T const* p, size_t n, T value)
+    {
+        return static_cast<size_t>(std::count(p, p + n, value));
+    }
+
+    static size_t find(T const* p, size_t n, T value)
+    {
+        return static_cast<size_t>(std::find(p, p + n, value) - p);
+    }
+};
+
+#if defined(ANY_ITERATOR_SIMD_VECTORS)
+// the vector_size attribute is only applied to dependent types reliably
+// outside of the class template that uses them
+template <typename T, size_t Width>
+struct vector_type
+{
+    typedef T type __attribute__((vector_size(Width)));
+};
+
+// The same kernels on Width byte vectors. They are always inlined, so that
+// they compile to the instruction set of the function they are called from.
+// Vectors are loaded with memcpy since the elements need not be aligned.
+template <size_t Width, typename T>
+struct vector_kernels
+{
+    static constexpr size_t lanes = Width / sizeof(T);
+
+    using vector = typename vector_type<T, Width>::type;
+    // comparisons give -1 in the lanes where they hold, 0 elsewhere
+    using mask = decltype(std::declval<vector>() == std::declval<vector>());
+    using mask_lane = typename std::decay<decltype(std::declval<mask>()[0])>::type;
+    using words = typename vector_type<unsigned long long, Width>::type;
+
+    ANY_ITERATOR_SIMD_INLINE static T sum(T const* p, size_t n)
+    {
+        vector acc = {};
+        size_t i = 0;
+        for (; i + lanes <= n; i += lanes)
+        {
+            vector v;
+            std::memcpy(&v, p + i, sizeof(v));
+            acc += v;
+        }
+
+        T result = T();
+        for (size_t j = 0; j != lanes; ++j)
+            result += acc[j];
+        for (; i < n; ++i)
+            result += p[i];
+        return result;
+    }
+
+    template <bool Max>
+    ANY_ITERATOR_SIMD_INLINE static T extremum(T const* p, size_t n)
+    {
+        vector acc;
+        for (size_t j = 0; j != lanes; ++j)
+            acc[j] = p[0];
+
+        size_t i = 0;
+        for (; i + lanes <= n; i += lanes)
+        {
+            vector v;
+            std::memcpy(&v, p + i, sizeof(v));
+            if constexpr (Max)
+                acc = acc < v ? v : acc;
+            else
+                acc = v < acc ? v : acc;
+        }
+
+        T result = acc[0];
+        for (size_t j = 1; j != lanes; ++j)
+            if (Max ? result < acc[j] : acc[j] < result)
+                result = acc[j];
+        for (; i < n; ++i)
+            if (Max ? result < p[i] : p[i] < result)
+                result = p[i];
+        return result;
+    }
+
+    ANY_ITERATOR_SIMD_INLINE static T min(T const* p, size_t n)
+    {
+        return extremum<false>(p, n);
+    }
+
+    ANY_ITERATOR_SIMD_INLINE static T max(T const* p, size_t n)
+    {
+        return extremum<true>(p, n);
+    }
+
+    // the lanes of acc count matches downwards from 0, so they are added to
+    // the result before they can overflow
+    ANY_ITERATOR_SIMD_INLINE static size_t count(T const* p, size_t n, T value)
+    {
+        constexpr size_t max_steps = static_cast<size_t>(std::numeric_limits<mask_lane>::max());
+
+        vector needle;
+        for (size_t j = 0; j != lanes; ++j)
+            needle[j] = value;
+
+        size_t result = 0;
+        size_t i = 0;
+        while (i + lanes <= n)
+        {
+            size_t steps = std::min((n - i) / lanes, max_steps);
+            mask acc = {};
+            for (size_t step = 0; step != steps; ++step, i += lanes)
+            {
+                vector v;
+                std::memcpy(&v, p + i, sizeof(v));
+                acc += v == needle;
+            }
+            for (size_t j = 0; j != lanes; ++j)
+                result += static_cast<size_t>(-static_cast<long long>(acc[j]));
+        }
+
+        for (; i < n; ++i)
+            result += p[i] == value;
+        return result;
+    }
+
+    ANY_ITERATOR_SIMD_INLINE static size_t find(T const* p, size_t n, T value)
+    {
+        vector needle;
+        for (size_t j = 0; j != lanes; ++j)
+            needle[j] = value;
+
+        size_t i = 0;
+        for (; i + lanes <= n; i += lanes)
+        {
+            vector v;
+            std::memcpy(&v, p + i, sizeof(v));
+            mask m = v == needle;
+            words w;
+            std::memcpy(&w, &m, sizeof(w));
+
+            unsigned long long any = 0;
+            for (size_t j = 0; j != Width / sizeof(unsigned long long); ++j)
+                any |= w[j];
+            if (any)
+                break;
+        }
+
+        // the match is within the next lanes elements if the loop broke
+        for (; i < n; ++i)
+            if (p[i] == value)
+                return i;
+        return n;
+    }
+};
+#endif
+
+#if defined(ANY_ITERATOR_SIMD_X86)
+inline bool has_avx2() noexcept
+{
+    static bool const value = __builtin_cpu_supports("avx2");
+    return value;
+}
+
+// the vector kernels compiled for AVX2, called only if the CPU has it
+template <typename T>
+struct avx2_kernels
+{
+    using kernels = vector_kernels<32, T>;
+
+    __attribute__((target("avx2"))) static T sum(T const* p, size_t n)
+    {
+        return kernels::sum(p, n);
+    }
+
+    __attribute__((target("avx2"))) static T min(T const* p, size_t n)
+    {
+        return kernels::min(p, n);
+    }
+
+    __attribute__((target("avx2"))) static T max(T const* p, size_t n)
+    {
+        return kernels::max(p, n);
+    }
+
+    __attribute__((target("avx2"))) static size_t count(T const* p, size_t n, T value)
+    {
+        return kernels::count(p, n, value);
+    }
+
+    __attribute__((target("avx2"))) static size_t find(T const* p, size_t n, T value)
+    {
+        return kernels::find(p, n, value);
+    }
+};
+#endif
+
+// Calls f with the best kernels for T: AVX2 or SSE2 on x86-64 depending on
+// the CPU, 16 byte generic vectors on other targets, loops for other types.
+template <typename T, typename F>
+decltype(auto) with_kernels(F&& f)
+{
+#if defined(ANY_ITERATOR_SIMD_VECTORS)
+    if constexpr (is_vectorizable<T>)
+    {
+#if defined(ANY_ITERATOR_SIMD_X86)
+        if (has_avx2())
+            return f(avx2_kernels<T>());
+#endif
+        return f(vector_kernels<16, T>());
+    }
+    else
+#endif
+        return f(scalar_kernels<T>());
+}
+
+// The kernels on memory, the element type is deduced from the pointer.
+template <typename T>
+T sum(T const* p, size_t n)
+{
+    return with_kernels<T>([&](auto kernels) { return kernels.sum(p, n); });
+}
+
+template <typename T>
+T min(T const* p, size_t n)
+{
+    assert(n != 0);
+    return with_kernels<T>([&](auto kernels) { return kernels.min(p, n); });
+}
+
+template <typename T>
+T max(T const* p, size_t n)
+{
+    assert(n != 0);
+    return with_kernels<T>([&](auto kernels) { return kernels.max(p, n); });
+}
+
+template <typename T>
+size_t count(T const* p, size_t n, T value)
+{
+    return with_kernels<T>([&](auto kernels) { return kernels.count(p, n, value); });
+}
+
+// index of the first element equal to value, n if there is none
+template <typename T>
+size_t find(T const* p, size_t n, T value)
+{
+    return with_kernels<T>([&](auto kernels) { return kernels.find(p, n, value); });
+}
+
+template <typename ValueType, typename Category, typename Storage>
+using enable_if_arithmetic = typename std::enable_if<
+    std::is_arithmetic<ValueType>::value
+ && !std::is_same<typename std::remove_cv<ValueType>::type, bool>::value
+ && !is_any_contiguous_iterator<any_iterator<ValueType, Category, Storage> >::value>::type;
+
+// Calls f(value_type const* block, size_t n) for consecutive non-empty
+// blocks of [first, last): the memory of a contiguous inner iterator at
+// once, values gathered into a buffer on the stack with next_batch otherwise.
+template <typename ValueType, typename Category, typename Storage, typename F>
+void for_each_block(any_iterator<ValueType, Category, Storage> const& first,
+                    any_iterator<ValueType, Category, Storage> const& last,
+                    F f)
+{
+    using value_type = typename std::remove_cv<ValueType>::type;
+
+    if constexpr (std::is_convertible<Category*, std::random_access_iterator_tag*>::value)
+    {
+        if (ValueType* data = first.contiguous_data())
+        {
+            if (size_t n = last - first)
+                f(static_cast<value_type const*>(data), n);
+            return;
+        }
+    }
+
+    value_type block[default_batch_size];
+    for_each_chunk(first, last, [&](ValueType* const* chunk, size_t n)
+    {
+        for (size_t i = 0; i != n; ++i)
+            block[i] = *chunk[i];
+        f(static_cast<value_type const*>(block), n);
+    });
+}
+
+// The kernels on any_iterator ranges. Elements are added in an unspecified
+// order, which may change the result for floating point types as with
+// std::reduce. min and max require a non-empty range.
+template <typename ValueType, typename Category, typename Storage,
+          typename = enable_if_arithmetic<ValueType, Category, Storage> >
+typename std::remove_cv<ValueType>::type sum(any_iterator<ValueType, Category, Storage> const& first,
+                                             any_iterator<ValueType, Category, Storage> const& last)
+{
+    typename std::remove_cv<ValueType>::type result = 0;
+    for_each_block(first, last, [&](auto const* block, size_t n) { result += simd::sum(block, n); });
+    return result;
+}
+
+template <typename ValueType, typename Category, typename Storage,
+          typename = enable_if_arithmetic<ValueType, Category, Storage> >
+typename std::remove_cv<ValueType>::type min(any_iterator<ValueType, Category, Storage> const& first,
+                                             any_iterator<ValueType, Category, Storage> const& last)
+{
+    assert(first != last);
+    typename std::remove_cv<ValueType>::type result = *first;
+    for_each_block(first, last, [&](auto const* block, size_t n) { result = std::min(result, simd::min(block, n)); });
+    return result;
+}
+
+template <typename ValueType, typename Category, typename Storage,
+          typename = enable_if_arithmetic<ValueType, Category, Storage> >
+typename std::remove_cv<ValueType>::type max(any_iterator<ValueType, Category, Storage> const& first,
+                                             any_iterator<ValueType, Category, Storage> const& last)
+{
+    assert(first != last);
+    typename std::remove_cv<ValueType>::type result = *first;
+    for_each_block(first, last, [&](auto const* block, size_t n) { result = std::max(result, simd::max(block, n)); });
+    return result;
+}
+
+template <typename ValueType, typename Category, typename Storage,
+          typename = enable_if_arithmetic<ValueType, Category, Storage> >
+std::ptrdiff_t count(any_iterator<ValueType, Category, Storage> const& first,
+                     any_iterator<ValueType, Category, Storage> const& last,
+                     typename std::remove_cv<ValueType>::type value)
+{
+    size_t result = 0;
+    for_each_block(first, last, [&](auto const* block, size_t n) { result += simd::count(block, n, value); });
+    return static_cast<std::ptrdiff_t>(result);
+}
+
+// Gathered blocks are searched as a whole, the returned iterator is then
+// advanced from the start of the block with the match.
+template <typename ValueType, typename Category, typename Storage,
+          typename = enable_if_arithmetic<ValueType, Category, Storage> >
+any_iterator<ValueType, Category, Storage> find(any_iterator<ValueType, Category, Storage> first,
+                                                any_iterator<ValueType, Category, Storage> const& last,
+                                                typename std::remove_cv<ValueType>::type value)
+{
+    using value_type = typename std::remove_cv<ValueType>::type;
+
+    if constexpr (std::is_convertible<Category*, std::random_access_iterator_tag*>::value)
+    {
+        if (ValueType* data = first.contiguous_data())
+            return first + simd::find(static_cast<value_type const*>(data), static_cast<size_t>(last - first), value);
+    }
+
+    ValueType* chunk[default_batch_size];
+    value_type block[default_batch_size];
+    for (;;)
+    {
+        any_iterator<ValueType, Category, Storage> block_first = first;
+        size_t n = first.next_batch(last, chunk, default_batch_size);
+        for (size_t i = 0; i != n; ++i)
+            block[i] = *chunk[i];
+
+        size_t k = simd::find(static_cast<value_type const*>(block), n, value);
+        if (k != n)
+            return std::next(std::move(block_first), static_cast<std::ptrdiff_t>(k));
+        if (n != default_batch_size)
+            return first;
+    }
+}
+}
+}
+
+namespace any_iterator_simd = any_iterator_impl::simd;
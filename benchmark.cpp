@@ -0,0 +1,768 @@
+#include <algorithm>
+#include <deque>
+#include <forward_list>
+#include <functional>
+#include <list>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <vector>
+#include "any_iterator.h"
+#include "any_iterator_parallel.h"
+#include "any_iterator_readahead.h"
+#include "any_iterator_simd.h"
+
+#include <benchmark/benchmark.h>
+
+// Per-element cost of any_iterator dispatch compared with raw iterators and
+// other erasure schemes. Use --benchmark_out=<file> --benchmark_out_format=json
+// (or the run_benchmark target) to record results for regression tracking.
+
+namespace
+{
+
+constexpr size_t number_of_elements = 1 << 14;
+
+// Like throwing_wrapper in the tests: too big and not nothrow movable, so
+// any_iterator has to put it on the heap.
+template <typename InnerIterator>
+struct big_iterator
+{
+    using value_type = typename std::iterator_traits<InnerIterator>::value_type;
+    using iterator_category = typename std::iterator_traits<InnerIterator>::iterator_category;
+    using pointer = typename std::iterator_traits<InnerIterator>::pointer;
+    using reference = typename std::iterator_traits<InnerIterator>::reference;
+    using difference_type = typename std::iterator_traits<InnerIterator>::difference_type;
+
+    big_iterator() = default;
+
+    big_iterator(InnerIterator inner)
+        : inner(inner)
+    {}
+
+    big_iterator(big_iterator const&) = default;
+
+    big_iterator(big_iterator&& other)
+        : inner(other.inner)
+    {}
+
+    big_iterator& operator=(big_iterator const&) = default;
+
+    reference operator*() const
+    {
+        return *inner;
+    }
+
+    reference operator[](difference_type n) const
+    {
+        return inner[n];
+    }
+
+    friend big_iterator& operator++(big_iterator& arg)
+    {
+        ++arg.inner;
+        return arg;
+    }
+
+    friend big_iterator operator++(big_iterator& arg, int)
+    {
+        return big_iterator(arg.inner++);
+    }
+
+    friend big_iterator& operator--(big_iterator& arg)
+    {
+        --arg.inner;
+        return arg;
+    }
+
+    friend big_iterator operator--(big_iterator& arg, int)
+    {
+        return big_iterator(arg.inner--);
+    }
+
+    friend big_iterator& operator+=(big_iterator& lhs, difference_type n)
+    {
+        lhs.inner += n;
+        return lhs;
+    }
+
+    friend big_iterator& operator-=(big_iterator& lhs, difference_type n)
+    {
+        lhs.inner -= n;
+        return lhs;
+    }
+
+    friend big_iterator operator+(big_iterator const& lhs, difference_type n)
+    {
+        return big_iterator(lhs.inner + n);
+    }
+
+    friend big_iterator operator-(big_iterator const& lhs, difference_type n)
+    {
+        return big_iterator(lhs.inner - n);
+    }
+
+    friend difference_type operator-(big_iterator const& lhs, big_iterator const& rhs)
+    {
+        return lhs.inner - rhs.inner;
+    }
+
+    friend bool operator==(big_iterator const& lhs, big_iterator const& rhs)
+    {
+        return lhs.inner == rhs.inner;
+    }
+
+    friend bool operator!=(big_iterator const& lhs, big_iterator const& rhs)
+    {
+        return lhs.inner != rhs.inner;
+    }
+
+    friend bool operator<(big_iterator const& lhs, big_iterator const& rhs)
+    {
+        return lhs.inner < rhs.inner;
+    }
+
+private:
+    InnerIterator inner;
+    void* padding[3] = {};
+};
+
+// Classic erasure with a virtual base class, one heap allocation per copy.
+template <typename ValueType>
+struct virtual_iterator_base
+{
+    virtual ~virtual_iterator_base() = default;
+    virtual std::unique_ptr<virtual_iterator_base> clone() const = 0;
+    virtual ValueType& deref() const = 0;
+    virtual void increment() = 0;
+    virtual bool equal(virtual_iterator_base const& other) const = 0;
+};
+
+template <typename ValueType, typename InnerIterator>
+struct virtual_iterator_impl : virtual_iterator_base<ValueType>
+{
+    explicit virtual_iterator_impl(InnerIterator inner)
+        : inner(inner)
+    {}
+
+    std::unique_ptr<virtual_iterator_base<ValueType> > clone() const override
+    {
+        return std::make_unique<virtual_iterator_impl>(inner);
+    }
+
+    ValueType& deref() const override
+    {
+        return *inner;
+    }
+
+    void increment() override
+    {
+        ++inner;
+    }
+
+    bool equal(virtual_iterator_base<ValueType> const& other) const override
+    {
+        return inner == static_cast<virtual_iterator_impl const&>(other).inner;
+    }
+
+private:
+    InnerIterator inner;
+};
+
+template <typename ValueType>
+struct virtual_forward_iterator
+{
+    using value_type = ValueType;
+    using iterator_category = std::forward_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using pointer = ValueType*;
+    using reference = ValueType&;
+
+    template <typename InnerIterator>
+    virtual_forward_iterator(InnerIterator inner)
+        : impl(std::make_unique<virtual_iterator_impl<ValueType, InnerIterator> >(inner))
+    {}
+
+    virtual_forward_iterator(virtual_forward_iterator const& other)
+        : impl(other.impl->clone())
+    {}
+
+    virtual_forward_iterator& operator=(virtual_forward_iterator const& other)
+    {
+        impl = other.impl->clone();
+        return *this;
+    }
+
+    ValueType& operator*() const
+    {
+        return impl->deref();
+    }
+
+    virtual_forward_iterator& operator++()
+    {
+        impl->increment();
+        return *this;
+    }
+
+    virtual_forward_iterator operator++(int)
+    {
+        virtual_forward_iterator copy = *this;
+        impl->increment();
+        return copy;
+    }
+
+    friend bool operator==(virtual_forward_iterator const& lhs, virtual_forward_iterator const& rhs)
+    {
+        return lhs.impl->equal(*rhs.impl);
+    }
+
+    friend bool operator!=(virtual_forward_iterator const& lhs, virtual_forward_iterator const& rhs)
+    {
+        return !(lhs == rhs);
+    }
+
+private:
+    std::unique_ptr<virtual_iterator_base<ValueType> > impl;
+};
+
+template <typename Container>
+struct container_source
+{
+    container_source()
+        : data(number_of_elements)
+    {
+        std::mt19937 rng(42);
+        std::generate(data.begin(), data.end(), std::ref(rng));
+    }
+
+    typename Container::iterator begin()
+    {
+        return data.begin();
+    }
+
+    typename Container::iterator end()
+    {
+        return data.end();
+    }
+
+    Container data;
+};
+
+template <typename Container>
+struct big_source : container_source<Container>
+{
+    big_iterator<typename Container::iterator> begin()
+    {
+        return container_source<Container>::begin();
+    }
+
+    big_iterator<typename Container::iterator> end()
+    {
+        return container_source<Container>::end();
+    }
+};
+
+// Relinks the nodes of data in random address order, so that every step
+// of a traversal is a cache miss on the critical path.
+inline void scatter(std::list<int>& data)
+{
+    std::vector<std::list<int>::iterator> nodes;
+    for (auto i = data.begin(); i != data.end(); ++i)
+        nodes.push_back(i);
+    std::shuffle(nodes.begin(), nodes.end(), std::mt19937(42));
+
+    std::list<int> scattered;
+    for (auto node : nodes)
+        scattered.splice(scattered.end(), data, node);
+    data.swap(scattered);
+}
+
+struct scattered_list_source : container_source<std::list<int> >
+{
+    scattered_list_source()
+    {
+        scatter(data);
+    }
+};
+
+using vector_source = container_source<std::vector<int> >;
+using list_source = container_source<std::list<int> >;
+using forward_list_source = container_source<std::forward_list<int> >;
+using deque_source = container_source<std::deque<int> >;
+using big_vector_source = big_source<std::vector<int> >;
+
+template <typename Source>
+using source_iterator = decltype(std::declval<Source&>().begin());
+
+template <typename Source>
+using source_category = typename std::iterator_traits<source_iterator<Source> >::iterator_category;
+
+struct raw
+{
+    template <typename Source>
+    using iterator = source_iterator<Source>;
+};
+
+template <typename Storage = default_storage>
+struct erased
+{
+    template <typename Source>
+    using iterator = any_iterator<int, source_category<Source>, Storage>;
+};
+
+struct virtual_erasure
+{
+    template <typename Source>
+    using iterator = virtual_forward_iterator<int>;
+};
+
+template <typename Source, typename Erasure>
+void scan(benchmark::State& state)
+{
+    using iterator = typename Erasure::template iterator<Source>;
+
+    Source source;
+    iterator const first = source.begin();
+    iterator const last = source.end();
+    for (auto _ : state)
+    {
+        int sum = 0;
+        for (iterator i = first; i != last; ++i)
+            sum += *i;
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * number_of_elements);
+}
+
+template <typename Source, typename Erasure>
+void postinc(benchmark::State& state)
+{
+    using iterator = typename Erasure::template iterator<Source>;
+
+    Source source;
+    iterator const first = source.begin();
+    iterator const last = source.end();
+    for (auto _ : state)
+    {
+        int sum = 0;
+        for (iterator i = first; i != last;)
+            sum += *i++;
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * number_of_elements);
+}
+
+template <typename Source, typename Erasure>
+void copy(benchmark::State& state)
+{
+    using iterator = typename Erasure::template iterator<Source>;
+
+    Source source;
+    std::vector<int> out(number_of_elements);
+    iterator const first = source.begin();
+    iterator const last = source.end();
+    for (auto _ : state)
+    {
+        std::copy(first, last, out.begin());
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * number_of_elements);
+}
+
+// scan and copy through the fused next(end) entry of the ops table
+template <typename Source, typename Erasure>
+void scan_next(benchmark::State& state)
+{
+    using iterator = typename Erasure::template iterator<Source>;
+
+    Source source;
+    iterator const first = source.begin();
+    iterator const last = source.end();
+    for (auto _ : state)
+    {
+        int sum = 0;
+        iterator i = first;
+        while (int* p = i.next(last))
+            sum += *p;
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * number_of_elements);
+}
+
+template <typename Source, typename Erasure>
+void copy_next(benchmark::State& state)
+{
+    using iterator = typename Erasure::template iterator<Source>;
+
+    Source source;
+    std::vector<int> out(number_of_elements);
+    iterator const first = source.begin();
+    iterator const last = source.end();
+    for (auto _ : state)
+    {
+        any_iterator_impl::copy(first, last, out.begin());
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * number_of_elements);
+}
+
+// std::find dispatching every element against the any_iterator_impl::find
+// overload dispatching once per range. 0 is almost surely not in the random
+// data, so both scan the whole range.
+template <typename Source, typename Erasure>
+void find(benchmark::State& state)
+{
+    using iterator = typename Erasure::template iterator<Source>;
+
+    Source source;
+    iterator const first = source.begin();
+    iterator const last = source.end();
+    for (auto _ : state)
+        benchmark::DoNotOptimize(std::find(first, last, 0) == last);
+    state.SetItemsProcessed(state.iterations() * number_of_elements);
+}
+
+template <typename Source, typename Erasure>
+void find_dispatched(benchmark::State& state)
+{
+    using iterator = typename Erasure::template iterator<Source>;
+
+    Source source;
+    iterator const first = source.begin();
+    iterator const last = source.end();
+    for (auto _ : state)
+        benchmark::DoNotOptimize(any_iterator_impl::find(first, last, 0) == last);
+    state.SetItemsProcessed(state.iterations() * number_of_elements);
+}
+
+// std::accumulate dispatching every element against the vectorized sum
+template <typename Source, typename Erasure>
+void accumulate(benchmark::State& state)
+{
+    using iterator = typename Erasure::template iterator<Source>;
+
+    Source source;
+    iterator const first = source.begin();
+    iterator const last = source.end();
+    for (auto _ : state)
+        benchmark::DoNotOptimize(std::accumulate(first, last, 0));
+    state.SetItemsProcessed(state.iterations() * number_of_elements);
+}
+
+template <typename Source, typename Erasure>
+void simd_sum(benchmark::State& state)
+{
+    using iterator = typename Erasure::template iterator<Source>;
+
+    Source source;
+    iterator const first = source.begin();
+    iterator const last = source.end();
+    for (auto _ : state)
+        benchmark::DoNotOptimize(any_iterator_simd::sum(first, last));
+    state.SetItemsProcessed(state.iterations() * number_of_elements);
+}
+
+template <typename Source, typename Erasure>
+void reverse_scan(benchmark::State& state)
+{
+    using iterator = std::reverse_iterator<typename Erasure::template iterator<Source> >;
+
+    Source source;
+    iterator const first(source.end());
+    iterator const last(source.begin());
+    for (auto _ : state)
+    {
+        int sum = 0;
+        for (iterator i = first; i != last; ++i)
+            sum += *i;
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * number_of_elements);
+}
+
+// the copy of the unsorted input is part of the measurement for every variant
+template <typename Source, typename Erasure>
+void sort(benchmark::State& state)
+{
+    using iterator = typename Erasure::template iterator<Source>;
+
+    Source source;
+    std::vector<int> const input(source.data.begin(), source.data.end());
+    iterator const first = source.begin();
+    iterator const last = source.end();
+    for (auto _ : state)
+    {
+        std::copy(input.begin(), input.end(), source.data.begin());
+        std::sort(first, last);
+        benchmark::DoNotOptimize(source.data);
+    }
+    state.SetItemsProcessed(state.iterations() * number_of_elements);
+}
+
+// the same sort split over the default thread pool
+template <typename Source, typename Erasure>
+void parallel_sort(benchmark::State& state)
+{
+    using iterator = typename Erasure::template iterator<Source>;
+
+    Source source;
+    std::vector<int> const input(source.data.begin(), source.data.end());
+    iterator const first = source.begin();
+    iterator const last = source.end();
+    for (auto _ : state)
+    {
+        std::copy(input.begin(), input.end(), source.data.begin());
+        any_iterator_parallel::sort(first, last);
+        benchmark::DoNotOptimize(source.data);
+    }
+    state.SetItemsProcessed(state.iterations() * number_of_elements);
+}
+
+// a growing table of cursors, reallocation relocates the iterators
+template <typename Source, typename Erasure>
+void grow(benchmark::State& state)
+{
+    using iterator = typename Erasure::template iterator<Source>;
+
+    Source source;
+    iterator const first = source.begin();
+    for (auto _ : state)
+    {
+        std::vector<iterator> cursors;
+        for (size_t i = 0; i != number_of_elements; ++i)
+            cursors.push_back(first);
+        benchmark::DoNotOptimize(cursors.data());
+    }
+    state.SetItemsProcessed(state.iterations() * number_of_elements);
+}
+
+// std::function based generator returning null at the end of the sequence
+template <typename Source>
+std::function<int*()> make_generator(Source& source)
+{
+    return [first = source.begin(), last = source.end()]() mutable -> int*
+    {
+        if (first == last)
+            return nullptr;
+        return &*first++;
+    };
+}
+
+template <typename Source>
+void scan_generator(benchmark::State& state)
+{
+    Source source;
+    for (auto _ : state)
+    {
+        std::function<int*()> next = make_generator(source);
+        int sum = 0;
+        while (int* p = next())
+            sum += *p;
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * number_of_elements);
+}
+
+// some hundred nanoseconds of work per element, standing in for decoding
+inline unsigned work(unsigned x)
+{
+    for (int i = 0; i != 256; ++i)
+        x = x * 1664525u + 1013904223u;
+    return x;
+}
+
+// input iterator decoding element i on dereference
+struct decoder
+{
+    using value_type = unsigned;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = unsigned;
+    using iterator_category = std::input_iterator_tag;
+
+    unsigned i;
+
+    unsigned operator*() const { return work(i); }
+    decoder& operator++() { ++i; return *this; }
+    decoder operator++(int) { decoder old = *this; ++i; return old; }
+    friend bool operator==(decoder const& lhs, decoder const& rhs) { return lhs.i == rhs.i; }
+    friend bool operator!=(decoder const& lhs, decoder const& rhs) { return lhs.i != rhs.i; }
+};
+
+// a consumer doing as much work per element as the decoder, directly and
+// with the decoding read ahead on another thread
+void decode(benchmark::State& state)
+{
+    for (auto _ : state)
+    {
+        unsigned sum = 0;
+        for (any_input_iterator<unsigned> i(decoder{0}, decoder{number_of_elements}); !i.at_end(); ++i)
+            sum += work(*i);
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * number_of_elements);
+}
+
+void decode_readahead(benchmark::State& state)
+{
+    for (auto _ : state)
+    {
+        unsigned sum = 0;
+        for (any_input_iterator<unsigned> i = any_iterator_readahead::make_iterator<unsigned>(decoder{0}, decoder{number_of_elements});
+             !i.at_end(); ++i)
+            sum += work(*i);
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * number_of_elements);
+}
+
+// a list of 1 << 23 nodes in random order, 256 MB of them with the
+// allocator's overhead, far beyond the last level cache; built once as it
+// takes seconds
+std::list<int> const& huge_scattered_list()
+{
+    static std::list<int> const data = []
+    {
+        std::list<int> data(1 << 23);
+        std::iota(data.begin(), data.end(), 0);
+        scatter(data);
+        return data;
+    }();
+    return data;
+}
+
+// state.range(1) rounds of arithmetic on every element
+auto scattered_work(unsigned& sum, int rounds)
+{
+    return [&sum, rounds](int x)
+    {
+        sum += x;
+        for (int i = 0; i != rounds; ++i)
+            sum = sum * 1664525u + 1013904223u;
+    };
+}
+
+// Scan of the huge list doing state.range(1) rounds of arithmetic per
+// element, with a cursor prefetching state.range(0) nodes ahead unless
+// that is 0. The prefetches only hide the misses behind the work, the
+// cursor itself still waits for every node.
+void scan_scattered(benchmark::State& state)
+{
+    std::list<int> const& data = huge_scattered_list();
+    any_forward_iterator<int const> const first(data.begin()), last(data.end());
+    size_t distance = state.range(0);
+    for (auto _ : state)
+    {
+        unsigned sum = 0;
+        auto f = scattered_work(sum, static_cast<int>(state.range(1)));
+        if (distance == 0)
+            any_iterator_impl::for_each(first, last, f);
+        else
+            for_each_prefetched(first, last, distance, f);
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * data.size());
+}
+
+// the same scan with plain std::list iterators, the baseline the
+// prefetching scan has to beat
+void scan_scattered_raw(benchmark::State& state)
+{
+    std::list<int> const& data = huge_scattered_list();
+    for (auto _ : state)
+    {
+        unsigned sum = 0;
+        auto f = scattered_work(sum, static_cast<int>(state.range(1)));
+        for (int x : data)
+            f(x);
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * data.size());
+}
+
+}
+
+#define FORWARD_BENCHMARKS(Source)                                     \
+    BENCHMARK_TEMPLATE(scan, Source, raw);                             \
+    BENCHMARK_TEMPLATE(scan, Source, erased<>);                        \
+    BENCHMARK_TEMPLATE(scan, Source, virtual_erasure);                 \
+    BENCHMARK_TEMPLATE(scan_generator, Source);                        \
+    BENCHMARK_TEMPLATE(postinc, Source, raw);                          \
+    BENCHMARK_TEMPLATE(postinc, Source, erased<>);                     \
+    BENCHMARK_TEMPLATE(postinc, Source, virtual_erasure);              \
+    BENCHMARK_TEMPLATE(copy, Source, raw);                             \
+    BENCHMARK_TEMPLATE(copy, Source, erased<>);                        \
+    BENCHMARK_TEMPLATE(copy, Source, virtual_erasure)
+
+#define BIDIRECTIONAL_BENCHMARKS(Source)                               \
+    FORWARD_BENCHMARKS(Source);                                        \
+    BENCHMARK_TEMPLATE(reverse_scan, Source, raw);                     \
+    BENCHMARK_TEMPLATE(reverse_scan, Source, erased<>)
+
+#define RANDOM_ACCESS_BENCHMARKS(Source)                               \
+    BIDIRECTIONAL_BENCHMARKS(Source);                                  \
+    BENCHMARK_TEMPLATE(sort, Source, raw);                             \
+    BENCHMARK_TEMPLATE(sort, Source, erased<>)
+
+FORWARD_BENCHMARKS(forward_list_source);
+BIDIRECTIONAL_BENCHMARKS(list_source);
+RANDOM_ACCESS_BENCHMARKS(vector_source);
+RANDOM_ACCESS_BENCHMARKS(deque_source);
+RANDOM_ACCESS_BENCHMARKS(big_vector_source);
+
+// effect of the storage policy on iterators that don't fit the default buffer
+BENCHMARK_TEMPLATE(scan, deque_source, erased<inline_storage<32> >);
+BENCHMARK_TEMPLATE(postinc, deque_source, erased<inline_storage<32> >);
+BENCHMARK_TEMPLATE(sort, deque_source, erased<inline_storage<32> >);
+BENCHMARK_TEMPLATE(postinc, big_vector_source, erased<pooled_storage<8> >);
+BENCHMARK_TEMPLATE(sort, big_vector_source, erased<pooled_storage<8> >);
+BENCHMARK_TEMPLATE(sort, deque_source, erased<shared_storage<default_storage> >);
+BENCHMARK_TEMPLATE(sort, big_vector_source, erased<shared_storage<default_storage> >);
+BENCHMARK_TEMPLATE(sort, big_vector_source, erased<shared_storage<pooled_storage<8> > >);
+
+// hot ops kept in the iterator against the shared table only, for traversals
+// where the load of the ops pointer is on the critical path
+BENCHMARK_TEMPLATE(scan, forward_list_source, erased<hot_ops_storage<default_storage> >);
+BENCHMARK_TEMPLATE(scan, list_source, erased<hot_ops_storage<default_storage> >);
+BENCHMARK_TEMPLATE(reverse_scan, list_source, erased<hot_ops_storage<default_storage> >);
+BENCHMARK_TEMPLATE(scan, scattered_list_source, raw);
+BENCHMARK_TEMPLATE(scan, scattered_list_source, erased<>);
+BENCHMARK_TEMPLATE(scan, scattered_list_source, erased<hot_ops_storage<default_storage> >);
+
+BENCHMARK_TEMPLATE(parallel_sort, vector_source, erased<>);
+BENCHMARK_TEMPLATE(parallel_sort, deque_source, erased<inline_storage<32> >);
+
+BENCHMARK_TEMPLATE(scan_next, forward_list_source, erased<>);
+BENCHMARK_TEMPLATE(scan_next, list_source, erased<>);
+BENCHMARK_TEMPLATE(copy_next, forward_list_source, erased<>);
+BENCHMARK_TEMPLATE(copy_next, list_source, erased<>);
+
+BENCHMARK_TEMPLATE(find, list_source, raw);
+BENCHMARK_TEMPLATE(find, list_source, erased<>);
+BENCHMARK_TEMPLATE(find_dispatched, list_source, erased<>);
+BENCHMARK_TEMPLATE(find, deque_source, raw);
+BENCHMARK_TEMPLATE(find, deque_source, erased<>);
+BENCHMARK_TEMPLATE(find_dispatched, deque_source, erased<>);
+
+BENCHMARK_TEMPLATE(accumulate, vector_source, raw);
+BENCHMARK_TEMPLATE(accumulate, vector_source, erased<>);
+BENCHMARK_TEMPLATE(simd_sum, vector_source, erased<>);
+BENCHMARK_TEMPLATE(accumulate, deque_source, erased<>);
+BENCHMARK_TEMPLATE(simd_sum, deque_source, erased<>);
+BENCHMARK_TEMPLATE(accumulate, list_source, erased<>);
+BENCHMARK_TEMPLATE(simd_sum, list_source, erased<>);
+
+BENCHMARK_TEMPLATE(grow, list_source, raw);
+BENCHMARK_TEMPLATE(grow, list_source, erased<>);
+BENCHMARK_TEMPLATE(grow, deque_source, raw);
+BENCHMARK_TEMPLATE(grow, deque_source, erased<inline_storage<32> >);
+
+BENCHMARK(decode);
+BENCHMARK(decode_readahead);
+
+BENCHMARK(scan_scattered)->ArgNames({"distance", "work"})
+    ->Args({0, 8})->Args({8, 8})
+    ->Args({0, 64})->Args({8, 64})
+    ->Args({0, 256})->Args({8, 256});
+BENCHMARK(scan_scattered_raw)->ArgNames({"distance", "work"})
+    ->Args({0, 8})->Args({0, 64})->Args({0, 256});
@@ -1,11 +1,34 @@
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <cstdlib>
+#include <deque>
 #include <forward_list>
+#include <fstream>
 #include <iostream>
+#include <iterator>
 #include <list>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
 #include <vector>
+#if __cplusplus > 201703L
+#include <span>
+#endif
 #include "any_iterator.h"
+#include "any_iterator_parallel.h"
+#include "any_iterator_readahead.h"
+#include "any_iterator_simd.h"
 
 #include <gtest/gtest.h>
+#include <unistd.h>
 
 struct throwing_wrapper_base
 {};
@@ -13,6 +36,35 @@ struct throwing_wrapper_base
 std::set<throwing_wrapper_base*> throwing_wrapper_instances;
 size_t number_of_copies = 0;
 size_t number_of_moves = 0;
+std::atomic<size_t> number_of_allocations(0);
+// operator new on this thread throws once this many allocations succeeded,
+// -1 for never
+thread_local long allocations_until_failure = -1;
+
+void* operator new(size_t size)
+{
+    ++number_of_allocations;
+    if (allocations_until_failure == 0)
+    {
+        allocations_until_failure = -1;
+        throw std::bad_alloc();
+    }
+    if (allocations_until_failure > 0)
+        --allocations_until_failure;
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
 
 template <typename InnerIterator>
 struct throwing_wrapper : throwing_wrapper_base
@@ -294,6 +346,49 @@ TEST(correctness, conversions)
     static_assert(!std::is_convertible<any_bidirectional_iterator<int>, any_random_access_iterator<int>>::value);
 }
 
+TEST(correctness, const_conversions)
+{
+    static_assert(!std::is_constructible<any_random_access_iterator<int>, any_random_access_iterator<int const>>::value);
+    static_assert(!std::is_constructible<any_random_access_iterator<int>, std::vector<int>::const_iterator>::value);
+
+    std::vector<int> a = {1, 2, 3};
+    any_random_access_iterator<int> i = a.begin();
+    any_bidirectional_iterator<int> end = a.end();
+
+    size_t old_noa = number_of_allocations;
+    any_random_access_iterator<int const> j = i;
+    any_forward_iterator<int const> k = std::move(i);
+    any_forward_iterator<int const> const_end = end;
+    EXPECT_EQ(old_noa, number_of_allocations.load());
+
+    EXPECT_NE(nullptr, j.target<std::vector<int>::iterator>());
+    EXPECT_EQ(a.data(), j.contiguous_data());
+    EXPECT_EQ(3, j[2]);
+    EXPECT_EQ(1, *k);
+    EXPECT_TRUE(++++++k == const_end);
+
+    int const* values[3];
+    EXPECT_EQ(3u, j.next_batch(j + 3, values, 3));
+    EXPECT_EQ(a.data() + 2, values[2]);
+}
+
+TEST(correctness, unwrap_nested)
+{
+    std::vector<int> a = {1, 2, 3};
+    any_random_access_iterator<int> i = a.begin();
+
+    // stored inline as an inner iterator of another layout
+    any_forward_iterator<int, inline_storage<32>> wrapped = i;
+    EXPECT_EQ(typeid(any_random_access_iterator<int>), wrapped.target_type());
+    EXPECT_EQ(2, *++wrapped);
+
+    // converting back unwraps instead of nesting again
+    any_forward_iterator<int> unwrapped = wrapped;
+    EXPECT_EQ(typeid(std::vector<int>::iterator), unwrapped.target_type());
+    EXPECT_EQ(2, *unwrapped);
+    EXPECT_TRUE(++unwrapped == any_forward_iterator<int>(a.begin() + 2));
+}
+
 TEST(correctness, incdec_big)
 {
     std::vector<int> a = {1, 2, 3, 4, 5};
@@ -345,6 +440,23 @@ TEST(correctness, assignment)
     EXPECT_EQ(*i, 2);
 }
 
+TEST(correctness, assignment_other_type)
+{
+    std::forward_list<int> a = {1, 2, 3};
+
+    any_forward_iterator<int> i = a.begin();
+    any_forward_iterator<int> j = make_throwing_wrapper(a.begin());
+    ++j;
+    i = j;
+    EXPECT_EQ(typeid(throwing_wrapper<std::forward_list<int>::iterator>), i.target_type());
+    EXPECT_EQ(2, *i);
+
+    any_forward_iterator<int> k;
+    k = std::move(i);
+    EXPECT_EQ(2, *k);
+    EXPECT_EQ(typeid(void), i.target_type());
+}
+
 TEST(correctness, subscript)
 {
     std::vector<int> a = {1, 2, 3, 4, 5};
@@ -452,9 +564,1542 @@ TEST(correctness, vector_2)
     EXPECT_TRUE(i[4] == 5);
 }
 
+TEST(correctness, storage_deque)
+{
+    static_assert(!any_iterator_impl::fits_small_storage<std::deque<int>::iterator, default_storage>);
+    static_assert(any_iterator_impl::fits_small_storage<std::deque<int>::iterator, inline_storage<32>>);
+
+    std::deque<int> a = {5, 3, 2, 4, 1};
+    std::sort(any_random_access_iterator<int, inline_storage<32>>(a.begin()),
+              any_random_access_iterator<int, inline_storage<32>>(a.end()));
+
+    std::deque<int> b = {1, 2, 3, 4, 5};
+    EXPECT_TRUE(a == b);
+}
+
+TEST(correctness, storage_big)
+{
+    std::vector<int> a = {1, 2, 3, 4, 5};
+    any_bidirectional_iterator<int, inline_storage<64>> i = make_throwing_wrapper(a.begin());
+    any_bidirectional_iterator<int, inline_storage<64>> j = i++;
+    EXPECT_EQ(1, *j);
+    EXPECT_EQ(2, *i);
+    j = i;
+    EXPECT_EQ(3, *++j);
+}
+
+TEST(correctness, storage_conversions)
+{
+    std::vector<int> a = {1, 2, 3};
+    any_random_access_iterator<int, inline_storage<16>> i = a.begin();
+    any_bidirectional_iterator<int> j = i;
+    any_forward_iterator<int, inline_storage<64>> k = j;
+    any_forward_iterator<int, inline_storage<64>> end = any_bidirectional_iterator<int>(any_random_access_iterator<int, inline_storage<16>>(a.end()));
+    EXPECT_EQ(1, *k);
+    ++k;
+    EXPECT_EQ(2, *k);
+    ++k;
+    EXPECT_EQ(3, *k);
+    ++k;
+    EXPECT_TRUE(k == end);
+
+    static_assert(!std::is_convertible<any_forward_iterator<int, inline_storage<16>>, any_bidirectional_iterator<int>>::value);
+}
+
+TEST(correctness, hot_ops_storage)
+{
+    std::list<int> a = {1, 2, 3};
+    using iterator = any_bidirectional_iterator<int, hot_ops_storage<default_storage>>;
+
+    iterator i = a.begin(), end = a.end();
+    int sum = 0;
+    for (iterator k = i; k != end; ++k)
+        sum += *k;
+    EXPECT_EQ(6, sum);
+    ++i;
+    iterator j = i++;
+    EXPECT_EQ(2, *j);
+    EXPECT_EQ(3, *i);
+    --i;
+    EXPECT_TRUE(i == j);
+
+    j = make_throwing_wrapper(a.begin());
+    EXPECT_EQ(1, *j);
+    i = std::move(j);
+    EXPECT_EQ(1, *i);
+    EXPECT_THROW(*j, bad_any_iterator);
+}
+
+// Nothrow movable iterator that remembers its own address, so that a move
+// copying its bytes is caught by the next dereference.
+struct self_checking_iterator
+{
+    using value_type = int;
+    using iterator_category = std::forward_iterator_tag;
+    using pointer = int*;
+    using reference = int&;
+    using difference_type = std::ptrdiff_t;
+
+    self_checking_iterator(int* p = nullptr) noexcept
+        : p(p)
+        , self(this)
+    {}
+
+    self_checking_iterator(self_checking_iterator const& other) noexcept
+        : p(other.p)
+        , self(this)
+    {}
+
+    self_checking_iterator& operator=(self_checking_iterator const& other) noexcept
+    {
+        p = other.p;
+        return *this;
+    }
+
+    int& operator*() const
+    {
+        EXPECT_EQ(this, self);
+        return *p;
+    }
+
+    self_checking_iterator& operator++() noexcept
+    {
+        ++p;
+        return *this;
+    }
+
+    self_checking_iterator operator++(int) noexcept
+    {
+        self_checking_iterator copy = *this;
+        ++p;
+        return copy;
+    }
+
+    friend bool operator==(self_checking_iterator const& lhs, self_checking_iterator const& rhs) noexcept
+    {
+        return lhs.p == rhs.p;
+    }
+
+    friend bool operator!=(self_checking_iterator const& lhs, self_checking_iterator const& rhs) noexcept
+    {
+        return lhs.p != rhs.p;
+    }
+
+    int* p;
+    self_checking_iterator const* self;
+};
+
+TEST(correctness, relocation)
+{
+    static_assert(!is_trivially_relocatable<any_random_access_iterator<int>>::value);
+    static_assert(is_trivially_relocatable<any_random_access_iterator<int, relocatable_storage<default_storage>>>::value);
+    static_assert(is_trivially_relocatable<any_forward_range<int, relocatable_storage<default_storage>>>::value);
+    static_assert(!is_trivially_relocatable<throwing_wrapper<int*>>::value);
+#if defined(__GLIBCXX__)
+    static_assert(is_trivially_relocatable<std::deque<int>::const_iterator>::value);
+    static_assert(is_trivially_relocatable<std::deque<std::string>::reverse_iterator>::value);
+#endif
+    // throwing_wrapper's move constructor may throw, so it is kept behind a pointer
+    static_assert(!any_iterator_impl::fits_small_storage<throwing_wrapper<int*>, inline_storage<64>>);
+    static_assert(any_iterator_impl::fits_small_storage<std::reverse_iterator<std::list<int>::iterator>, default_storage>);
+    // nothrow movable iterators are kept inline unless the storage only takes
+    // trivially relocatable ones
+    static_assert(any_iterator_impl::fits_small_storage<self_checking_iterator, inline_storage<16>>);
+    static_assert(!any_iterator_impl::fits_small_storage<self_checking_iterator, relocatable_storage<inline_storage<16>>>);
+
+    std::vector<int> a = {1, 2, 3, 4};
+    std::list<int> b = {5, 6};
+
+    size_t old_moves = number_of_moves;
+    std::vector<any_forward_iterator<int>> v;
+    for (size_t i = 0; i != 100; ++i)
+    {
+        if (i % 2)
+            v.push_back(make_throwing_wrapper(a.begin() + i % 4));
+        else
+            v.push_back(b.begin());
+    }
+    EXPECT_EQ(old_moves + 50, number_of_moves);
+    for (size_t i = 0; i != 100; ++i)
+        EXPECT_EQ(i % 2 ? a[i % 4] : 5, *v[i]);
+
+    alignas(any_forward_iterator<int>) unsigned char buffer[4 * sizeof(any_forward_iterator<int>)];
+    any_forward_iterator<int>* dst = reinterpret_cast<any_forward_iterator<int>*>(buffer);
+    size_t instances = throwing_wrapper_instances.size();
+    EXPECT_EQ(dst + 4, relocate(v.data() + 96, v.data() + 100, dst));
+    new (v.data() + 96) any_forward_iterator<int>[4];
+    for (size_t i = 0; i != 4; ++i)
+        EXPECT_EQ(i % 2 ? a[(i + 96) % 4] : 5, *dst[i]);
+    EXPECT_EQ(instances, throwing_wrapper_instances.size());
+    std::destroy(dst, dst + 4);
+
+    any_forward_iterator<int> i = b.begin(), j = make_throwing_wrapper(a.begin() + 1);
+    swap(i, j);
+    EXPECT_EQ(2, *i);
+    EXPECT_EQ(6, *++j);
+    EXPECT_TRUE(j == any_forward_iterator<int>(std::next(b.begin())));
+    EXPECT_EQ(typeid(throwing_wrapper<std::vector<int>::iterator>), i.target_type());
+}
+
+TEST(correctness, relocation_moves_inline_iterators)
+{
+    std::vector<int> a = {1, 2, 3, 4};
+    using iterator = any_forward_iterator<int, inline_storage<16>>;
+    using relocatable_iterator = any_forward_iterator<int, relocatable_storage<inline_storage<16>>>;
+
+    std::vector<iterator> v;
+    std::vector<relocatable_iterator> w;
+    for (size_t i = 0; i != 100; ++i)
+    {
+        v.push_back(self_checking_iterator(a.data() + i % 4));
+        w.push_back(self_checking_iterator(a.data() + i % 4));
+    }
+    for (size_t i = 0; i != 100; ++i)
+    {
+        EXPECT_EQ(a[i % 4], *v[i]);
+        EXPECT_EQ(a[i % 4], *w[i]);
+    }
+
+    alignas(iterator) unsigned char buffer[4 * sizeof(iterator)];
+    iterator* dst = reinterpret_cast<iterator*>(buffer);
+    EXPECT_EQ(dst + 4, relocate(v.data() + 96, v.data() + 100, dst));
+    new (v.data() + 96) iterator[4];
+    for (size_t i = 0; i != 4; ++i)
+        EXPECT_EQ(a[i], *dst[i]);
+    std::destroy(dst, dst + 4);
+
+    swap(v[0], v[1]);
+    EXPECT_EQ(2, *v[0]);
+    EXPECT_EQ(1, *v[1]);
+    iterator k = std::move(v[2]);
+    v[3] = std::move(k);
+    EXPECT_EQ(3, *v[3]);
+
+    any_forward_range<int, inline_storage<16>> r(self_checking_iterator(a.data()), self_checking_iterator(a.data() + 4));
+    auto s = std::move(r);
+    EXPECT_EQ(10, std::accumulate(s.begin(), s.end(), 0));
+}
+
+TEST(correctness, pooled_storage)
+{
+    static_assert(!any_iterator_impl::fits_small_storage<std::deque<int>::iterator, pooled_storage<8>>);
+
+    std::deque<int> a = {1, 2, 3, 4, 5};
+    using iterator = any_forward_iterator<int, pooled_storage<8>>;
+
+    auto copy_heavy_loop = [&]
+    {
+        iterator const end = a.end();
+        int sum = 0;
+        for (iterator i = a.begin(); i != end; i++)
+        {
+            iterator j = i;
+            sum += *j;
+        }
+        return sum;
+    };
+
+    EXPECT_EQ(15, copy_heavy_loop());
+
+    size_t old_noa = number_of_allocations;
+    for (size_t n = 0; n != 100; ++n)
+        EXPECT_EQ(15, copy_heavy_loop());
+    EXPECT_EQ(old_noa, number_of_allocations.load());
+}
+
+TEST(correctness, shared_storage)
+{
+    using shared = shared_storage<default_storage>;
+    static_assert(any_iterator_impl::shares_heap_storage<std::deque<int>::iterator, shared>);
+    static_assert(!any_iterator_impl::shares_heap_storage<int*, shared>);
+
+    auto sort_allocations = [](auto tag)
+    {
+        using iterator = typename decltype(tag)::type;
+
+        std::deque<int> a(1000);
+        for (size_t i = 0; i != a.size(); ++i)
+            a[i] = static_cast<int>(i * 7919 % 1000);
+
+        size_t old_noa = number_of_allocations;
+        std::sort(iterator(a.begin()), iterator(a.end()));
+        size_t noa = number_of_allocations - old_noa;
+        EXPECT_TRUE(std::is_sorted(a.begin(), a.end()));
+        return noa;
+    };
+
+    size_t owned = sort_allocations(std::common_type<any_random_access_iterator<int>>());
+    size_t shared_noa = sort_allocations(std::common_type<any_random_access_iterator<int, shared>>());
+    EXPECT_LT(shared_noa * 4, owned);
+
+    // shared blocks come from the pool too
+    using pooled_shared = shared_storage<pooled_storage<8>>;
+    sort_allocations(std::common_type<any_random_access_iterator<int, pooled_shared>>());
+    EXPECT_EQ(0u, sort_allocations(std::common_type<any_random_access_iterator<int, pooled_shared>>()));
+
+    std::vector<int> v = {1, 2, 3, 4};
+    size_t instances = throwing_wrapper_instances.size();
+    {
+        using iterator = any_bidirectional_iterator<int, shared_storage<default_storage, std::atomic<size_t>>>;
+        iterator i = make_throwing_wrapper(v.begin());
+        iterator j = i, k = i;
+        EXPECT_EQ(instances + 1, throwing_wrapper_instances.size());
+
+        ++j;
+        EXPECT_EQ(instances + 2, throwing_wrapper_instances.size());
+        EXPECT_EQ(1, *i);
+        EXPECT_EQ(2, *j);
+        EXPECT_TRUE(i == k);
+
+        iterator l = j++;
+        EXPECT_EQ(2, *l);
+        EXPECT_EQ(3, *j);
+        l = j;
+        EXPECT_EQ(instances + 2, throwing_wrapper_instances.size());
+        EXPECT_EQ(3, *l--);
+        EXPECT_EQ(2, *l);
+        EXPECT_EQ(3, *j);
+
+        std::thread([m = std::move(k)] { EXPECT_EQ(1, *m); }).join();
+    }
+    EXPECT_EQ(instances, throwing_wrapper_instances.size());
+}
+
+TEST(correctness, next_batch)
+{
+    std::forward_list<int> a = {1, 2, 3, 4, 5};
+    any_forward_iterator<int> i = a.begin();
+    any_forward_iterator<int> const end = a.end();
+
+    int* batch[3];
+    EXPECT_EQ(3u, i.next_batch(end, batch, 3));
+    EXPECT_EQ(1, *batch[0]);
+    EXPECT_EQ(2, *batch[1]);
+    EXPECT_EQ(3, *batch[2]);
+    EXPECT_EQ(4, *i);
+    EXPECT_EQ(2u, i.next_batch(end, batch, 3));
+    EXPECT_EQ(4, *batch[0]);
+    EXPECT_EQ(5, *batch[1]);
+    EXPECT_TRUE(i == end);
+    EXPECT_EQ(0u, i.next_batch(end, batch, 3));
+}
+
+TEST(correctness, next)
+{
+    std::forward_list<int> a = {1, 2, 3};
+    any_forward_iterator<int> i = a.begin();
+    any_forward_iterator<int> const end = a.end();
+
+    EXPECT_EQ(1, i.next());
+    int* p = i.next(end);
+    ASSERT_TRUE(p);
+    EXPECT_EQ(2, *p);
+    EXPECT_EQ(3, *i);
+    EXPECT_EQ(3, *i.next(end));
+    EXPECT_TRUE(i == end);
+    EXPECT_EQ(nullptr, i.next(end));
+
+    any_forward_iterator<int const> j = a.begin();
+    int const& first = j.next();
+    EXPECT_EQ(&a.front(), &first);
+    EXPECT_EQ(2, *j);
+
+    any_forward_iterator<int> empty;
+    EXPECT_THROW(empty.next(), bad_any_iterator);
+    EXPECT_THROW(empty.next(empty), bad_any_iterator);
+
+    std::forward_list<int> b;
+    any_iterator_impl::copy(any_forward_iterator<int>(a.begin()), end, std::front_inserter(b));
+    std::forward_list<int> c = {3, 2, 1};
+    EXPECT_TRUE(b == c);
+
+    std::list<int> d = {1, 2, 3, 4};
+    int sum = 0;
+    any_iterator_impl::for_each(any_bidirectional_iterator<int>(d.begin()),
+                                any_bidirectional_iterator<int>(d.end()),
+                                [&](int x) { sum += x; });
+    EXPECT_EQ(10, sum);
+}
+
+TEST(correctness, prefetch)
+{
+    std::list<int> a(100);
+    std::iota(a.begin(), a.end(), 0);
+    std::vector<int> b(a.begin(), a.end());
+    std::map<int, int> c = {{1, 10}, {2, 20}, {3, 30}};
+
+    EXPECT_TRUE(any_bidirectional_iterator<int>(a.begin()).prefetches());
+    EXPECT_TRUE((any_forward_iterator<std::pair<int const, int> const>(c.cbegin()).prefetches()));
+    EXPECT_FALSE(any_forward_iterator<int>(b.begin()).prefetches());
+    // like next(end), only for iterators returning references
+    EXPECT_FALSE((any_iterator<int, std::forward_iterator_tag, default_storage, int>(a.begin()).prefetches()));
+    EXPECT_FALSE(any_forward_iterator<int>().prefetches());
+
+    std::list<int> d = {1, 2, 3};
+    any_forward_iterator<int> i = d.begin(), ahead = std::next(d.begin()), end = d.end();
+    EXPECT_EQ(1, *i.next_prefetched(ahead, end));
+    EXPECT_TRUE(ahead == any_forward_iterator<int>(std::next(d.begin(), 2)));
+    EXPECT_EQ(2, *i.next_prefetched(ahead, end));
+    EXPECT_TRUE(ahead == end);
+    EXPECT_EQ(3, *i.next_prefetched(ahead, end));
+    EXPECT_EQ(nullptr, i.next_prefetched(ahead, end));
+    EXPECT_TRUE(i == end);
+    EXPECT_TRUE(ahead == end);
+
+    for (size_t distance : {0, 1, 7, 99, 100, 1000})
+    {
+        std::vector<int> seen;
+        for_each_prefetched(any_forward_iterator<int>(a.begin()), any_forward_iterator<int>(a.end()), distance,
+                            [&](int x) { seen.push_back(x); });
+        EXPECT_EQ(b, seen);
+
+        seen.clear();
+        for_each_prefetched(any_forward_iterator<int>(b.begin()), any_forward_iterator<int>(b.end()), distance,
+                            [&](int x) { seen.push_back(x); });
+        EXPECT_EQ(b, seen);
+    }
+
+    int sum = 0;
+    for_each_prefetched(any_forward_iterator<std::pair<int const, int> const>(c.cbegin()),
+                        any_forward_iterator<std::pair<int const, int> const>(c.cend()), 2,
+                        [&](std::pair<int const, int> const& x) { sum += x.second; });
+    EXPECT_EQ(60, sum);
+
+    std::list<int> empty;
+    for_each_prefetched(any_forward_iterator<int>(empty.begin()), any_forward_iterator<int>(empty.end()), 4,
+                        [](int) { FAIL(); });
+}
+
+TEST(correctness, algorithms)
+{
+    std::list<int> a = {1, 2, 2, 3, 5, 8};
+    using iterator = any_bidirectional_iterator<int>;
+    iterator const first = a.begin(), last = a.end();
+
+    EXPECT_TRUE(any_iterator_impl::find(first, last, 3) == iterator(std::next(a.begin(), 3)));
+    EXPECT_TRUE(any_iterator_impl::find(first, last, 4) == last);
+    EXPECT_EQ(2, any_iterator_impl::count(first, last, 2));
+    EXPECT_EQ(21, any_iterator_impl::accumulate(first, last, 0));
+    EXPECT_EQ(21.5, any_iterator_impl::accumulate(first, last, 0.5));
+    EXPECT_EQ(4, *any_iterator_impl::lower_bound(first, last, 4) - 1);
+    EXPECT_TRUE(any_iterator_impl::lower_bound(first, last, 9) == last);
+    EXPECT_EQ(1, *first);
+
+    std::list<int> b = a;
+    EXPECT_TRUE(any_iterator_impl::equal(first, last, iterator(b.begin())));
+    b.back() = 9;
+    EXPECT_FALSE(any_iterator_impl::equal(first, last, iterator(b.begin())));
+    std::vector<int> c(a.begin(), a.end());
+    EXPECT_TRUE(any_iterator_impl::equal(first, last, iterator(c.begin())));
+
+    std::vector<int> d(a.size());
+    EXPECT_TRUE(any_iterator_impl::copy(first, last, d.begin()) == d.end());
+    EXPECT_TRUE(c == d);
+
+    std::deque<int> e(c.begin(), c.end());
+    using random_access_iterator = any_random_access_iterator<int const>;
+    int f[6] = {};
+    EXPECT_EQ(f + 6, any_iterator_impl::copy(random_access_iterator(e.begin()), random_access_iterator(e.end()), f));
+    EXPECT_TRUE(std::equal(c.begin(), c.end(), f));
+    EXPECT_TRUE(any_iterator_impl::find(random_access_iterator(e.begin()), random_access_iterator(e.end()), 8)
+             == random_access_iterator(e.end() - 1));
+
+    struct no_operators
+    {};
+    static_assert(!any_iterator_impl::has_inner_equal<no_operators*, no_operators>::value);
+    static_assert(!any_iterator_impl::has_inner_less<no_operators*, no_operators>::value);
+    static_assert(!any_iterator_impl::has_inner_plus<no_operators*, no_operators>::value);
+    static_assert(any_iterator_impl::has_inner_copy<no_operators*, no_operators>::value);
+    static_assert(any_iterator_impl::has_inner_plus<std::string*, std::string>::value);
+    static_assert(!any_iterator_impl::has_inner_copy<std::string*, int>::value);
+}
+
+// the base is not the first subobject, so references to it are offset
+// from the derived objects, which are bigger
+struct shape_tag
+{
+    char tag[24] = {};
+    virtual ~shape_tag() = default;
+};
+
+struct shape
+{
+    int id;
+
+    shape(int id) : id(id) {}
+    virtual ~shape() = default;
+    virtual int corners() const { return 0; }
+
+    friend bool operator==(shape const& lhs, shape const& rhs) { return lhs.id == rhs.id; }
+    friend bool operator<(shape const& lhs, shape const& rhs) { return lhs.id < rhs.id; }
+};
+
+struct polygon : shape_tag, shape
+{
+    int n;
+    double area[3] = {};
+
+    polygon(int id, int n) : shape(id), n(n) {}
+    int corners() const override { return n; }
+
+    friend bool operator==(polygon const& lhs, polygon const& rhs) { return lhs.id == rhs.id && lhs.n == rhs.n; }
+};
+
+TEST(correctness, derived_elements)
+{
+    static_assert(sizeof(polygon) != sizeof(shape));
+    // references to converted temporaries would dangle
+    static_assert(!std::is_constructible<any_forward_iterator<int const>, std::vector<double>::iterator>::value);
+    static_assert(!std::is_constructible<any_forward_iterator<bool const>, std::vector<bool>::iterator>::value);
+    static_assert(std::is_constructible<any_forward_iterator<int const>, std::vector<int>::iterator>::value);
+    static_assert(std::is_constructible<any_forward_iterator<shape const>, std::list<polygon>::iterator>::value);
+    static_assert(std::is_constructible<any_iterator<double, std::forward_iterator_tag, default_storage, double>, std::vector<int>::iterator>::value);
+    std::vector<polygon> a = {{0, 3}, {1, 4}, {2, 5}};
+    std::list<polygon> b(a.begin(), a.end());
+
+    any_random_access_iterator<shape> first(a.begin()), last(a.end());
+    EXPECT_EQ(3, last - first);
+    EXPECT_EQ(nullptr, first.contiguous_data());
+    for (size_t i = 0; i != a.size(); ++i)
+    {
+        shape* p = &first[i];
+        EXPECT_EQ(static_cast<shape*>(&a[i]), p);
+        EXPECT_NE(static_cast<void*>(&a[i]), static_cast<void*>(p));
+        EXPECT_EQ(static_cast<int>(i) + 3, (first + i)->corners());
+    }
+
+    // scanning the elements of different containers through one type
+    std::vector<any_forward_iterator<shape const> > pools = {a.begin(), a.end(), b.begin(), b.end()};
+    int corners = 0;
+    for (size_t i = 0; i != pools.size(); i += 2)
+        for (any_forward_iterator<shape const> j = pools[i]; j != pools[i + 1]; ++j)
+            corners += j->corners();
+    EXPECT_EQ(24, corners);
+
+    std::vector<int> ids;
+    for_each_chunk(any_forward_iterator<shape>(b.begin()), any_forward_iterator<shape>(b.end()),
+                   [&](shape* const* chunk, size_t n)
+    {
+        for (size_t i = 0; i != n; ++i)
+            ids.push_back(chunk[i]->id);
+    });
+    EXPECT_EQ((std::vector<int>{0, 1, 2}), ids);
+    any_forward_iterator<shape> k(b.begin()), end(b.end());
+    EXPECT_EQ(static_cast<shape*>(&b.front()), k.next(end));
+
+    // the algorithms compare the elements as shapes, not as polygons
+    std::vector<polygon> c = {{0, 6}, {1, 7}, {2, 8}};
+    EXPECT_TRUE(any_iterator_impl::equal(first, last, any_random_access_iterator<shape>(c.begin())));
+    EXPECT_EQ(2, any_iterator_impl::find(first, last, shape(2))->id);
+    EXPECT_TRUE(any_iterator_impl::find(any_forward_iterator<shape>(b.begin()), end, polygon(1, 9)) == k);
+    EXPECT_EQ(1, any_iterator_impl::count(first, last, polygon(1, 9)));
+    EXPECT_TRUE(any_iterator_impl::lower_bound(first, last, shape(1)) == first + 1);
+}
+
+TEST(correctness, for_each_chunk)
+{
+    std::list<int> a;
+    for (int i = 0; i != 200; ++i)
+        a.push_back(i);
+
+    int sum = 0;
+    size_t chunks = 0;
+    for_each_chunk(any_bidirectional_iterator<int>(a.begin()),
+                   any_bidirectional_iterator<int>(a.end()),
+                   [&](int* const* chunk, size_t n)
+    {
+        ++chunks;
+        for (size_t i = 0; i != n; ++i)
+            sum += *chunk[i];
+    });
+
+    EXPECT_EQ(199 * 100, sum);
+    EXPECT_EQ(4u, chunks);
+}
+
+TEST(correctness, contiguous_data)
+{
+    std::vector<int> a = {1, 2, 3, 4, 5};
+    int b[3] = {1, 2, 3};
+    std::deque<int> c = {1, 2, 3};
+
+    any_random_access_iterator<int> i = a.begin() + 2;
+    EXPECT_EQ(a.data() + 2, i.contiguous_data());
+    any_random_access_iterator<int> const end = a.end();
+    EXPECT_EQ(a.data() + 5, end.contiguous_data());
+    any_random_access_iterator<int const> j = a.cbegin();
+    EXPECT_EQ(a.data(), j.contiguous_data());
+    any_random_access_iterator<int> k = b + 1;
+    EXPECT_EQ(b + 1, k.contiguous_data());
+
+    any_random_access_iterator<int> l = c.begin();
+    EXPECT_EQ(nullptr, l.contiguous_data());
+    any_random_access_iterator<int> m = make_throwing_wrapper(a.begin());
+    EXPECT_EQ(nullptr, m.contiguous_data());
+    EXPECT_EQ(nullptr, any_random_access_iterator<int>().contiguous_data());
+}
+
+TEST(correctness, contiguous_algorithms)
+{
+    using iterator = any_random_access_iterator<int>;
+
+    std::vector<int> a = {1, 2, 3, 4, 5};
+    std::vector<int> b(5);
+    std::deque<int> c(5);
+
+    iterator out = any_iterator_impl::copy(iterator(a.begin()), iterator(a.end()), iterator(b.begin()));
+    EXPECT_TRUE(out == iterator(b.end()));
+    EXPECT_TRUE(a == b);
+
+    EXPECT_TRUE(any_iterator_impl::copy(iterator(a.begin()), iterator(a.end()), c.begin()) == c.end());
+    EXPECT_TRUE(any_iterator_impl::equal(iterator(a.begin()), iterator(a.end()), iterator(c.begin())));
+    EXPECT_TRUE(any_iterator_impl::equal(iterator(c.begin()), iterator(c.end()), iterator(a.begin())));
+
+    any_iterator_impl::fill(iterator(b.begin()), iterator(b.end()), 7);
+    EXPECT_TRUE(b == std::vector<int>(5, 7));
+    EXPECT_FALSE(any_iterator_impl::equal(iterator(a.begin()), iterator(a.end()), iterator(b.begin())));
+
+    any_iterator_impl::fill(iterator(c.begin()), iterator(c.end()), 7);
+    EXPECT_TRUE(any_iterator_impl::equal(iterator(b.begin()), iterator(b.end()), iterator(c.begin())));
+}
+
+#if defined(__cpp_lib_concepts)
+TEST(correctness, contiguous_category)
+{
+    static_assert(std::contiguous_iterator<any_contiguous_iterator<int> >);
+    static_assert(std::contiguous_iterator<any_contiguous_iterator<int const> >);
+    static_assert(sizeof(any_contiguous_iterator<int>) == sizeof(int*));
+    static_assert(!std::is_constructible<any_contiguous_iterator<int>, std::deque<int>::iterator>::value);
+    static_assert(!std::is_constructible<any_contiguous_iterator<int>, std::vector<int>::const_iterator>::value);
+
+    std::vector<int> a = {5, 3, 4, 1, 2};
+    any_contiguous_iterator<int> first = a.begin(), last = a.end();
+    EXPECT_EQ(5, last - first);
+    EXPECT_EQ(4, first[2]);
+    EXPECT_EQ(a.data(), std::to_address(first));
+
+    std::sort(first, last);
+    EXPECT_EQ((std::vector<int>{1, 2, 3, 4, 5}), a);
+
+    std::span<int> s(first, last);
+    EXPECT_EQ(a.data(), s.data());
+    EXPECT_EQ(5u, s.size());
+
+    int b[] = {1, 2, 3};
+    any_contiguous_iterator<int const> c = a.cbegin();
+    c = std::begin(b);
+    EXPECT_EQ(2, *++c);
+}
+
+TEST(correctness, contiguous_category_conversions)
+{
+    std::vector<int> a = {1, 2, 3};
+    any_contiguous_iterator<int> first = a.begin(), last = a.end();
+
+    any_random_access_iterator<int> i = first, end = last;
+    EXPECT_EQ(3, end - i);
+    EXPECT_EQ(a.data(), i.contiguous_data());
+    EXPECT_NE(nullptr, i.target<int*>());
+
+    any_bidirectional_iterator<int, inline_storage<16> > j = first;
+    EXPECT_EQ(1, *j);
+    any_forward_iterator<int> k = first;
+    ++k;
+    EXPECT_EQ(2, *k);
+}
+#endif
+
+TEST(correctness, input_iterator)
+{
+    static_assert(!std::is_copy_constructible<any_input_iterator<int>>::value);
+    static_assert(std::is_nothrow_move_constructible<any_input_iterator<int>>::value);
+    static_assert(std::is_same<any_iterator<int, std::input_iterator_tag>, any_input_iterator<int>>::value);
+
+    std::istringstream in("1 2 3 4");
+    any_input_iterator<int> i{std::istream_iterator<int>(in), std::istream_iterator<int>()};
+    any_input_iterator<int> end;
+
+    int sum = 0;
+    for (; i != end; ++i)
+        sum += *i;
+    EXPECT_EQ(10, sum);
+    EXPECT_TRUE(i.at_end());
+    EXPECT_THROW(*end, bad_any_iterator);
+
+    std::list<int> a = {1, 2, 3};
+    any_input_iterator<int> j(a.begin(), a.end());
+    j++;
+    any_input_iterator<int> k = std::move(j);
+    EXPECT_EQ(2, *k);
+    EXPECT_TRUE(j == end);
+    EXPECT_FALSE(k == end);
+
+    // the dispatching algorithm overloads only take forward iterators, so
+    // unqualified calls find the standard algorithms
+    static_assert(!any_iterator_impl::is_dispatched<any_input_iterator<int>>);
+    static_assert(!any_iterator_impl::is_dispatched<any_output_iterator<int>>);
+    any_input_iterator<int> in_first(a.begin(), a.end()), in_last;
+    EXPECT_EQ(6, accumulate(std::move(in_first), std::move(in_last), 0));
+}
+
+// move-only input iterator owning its buffer, with iterator_concept and no
+// iterator_category as C++20 move-only iterators usually have
+struct move_only_reader
+{
+    using value_type = int;
+    using difference_type = std::ptrdiff_t;
+    using iterator_concept = std::input_iterator_tag;
+
+    std::unique_ptr<int[]> buffer;
+    size_t pos;
+    size_t size;
+
+    move_only_reader(size_t size)
+        : buffer(new int[size])
+        , pos(0)
+        , size(size)
+    {
+        for (size_t i = 0; i != size; ++i)
+            buffer[i] = static_cast<int>(i);
+    }
+
+    int const& operator*() const { return buffer[pos]; }
+    move_only_reader& operator++() { ++pos; return *this; }
+    void operator++(int) { ++pos; }
+};
+
+struct move_only_reader_end
+{};
+
+bool operator==(move_only_reader const& it, move_only_reader_end)
+{
+    return it.pos == it.size;
+}
+
+TEST(correctness, input_iterator_move_only)
+{
+    static_assert(!std::is_copy_constructible<move_only_reader>::value);
+    static_assert(std::is_constructible<any_input_iterator<int>, move_only_reader, move_only_reader_end>::value);
+    static_assert(!std::is_constructible<any_forward_iterator<int>, move_only_reader>::value);
+
+    any_input_iterator<int> i{move_only_reader(100), move_only_reader_end()};
+    int sum = 0;
+    for (; !i.at_end(); ++i)
+        sum += *i;
+    EXPECT_EQ(4950, sum);
+
+    any_input_iterator<int, inline_storage<32> > j{move_only_reader(3), move_only_reader_end()};
+    any_input_iterator<int, inline_storage<32> > k = std::move(j);
+    k++;
+    EXPECT_EQ(1, *k);
+    EXPECT_TRUE(j.at_end());
+}
+
+TEST(correctness, output_iterator)
+{
+    static_assert(!std::is_copy_constructible<any_output_iterator<int>>::value);
+
+    std::vector<int> a;
+    any_output_iterator<int> out = std::back_inserter(a);
+    for (int i = 0; i != 3; ++i)
+        *out++ = i;
+    int x = 3;
+    *out = x;
+    EXPECT_EQ((std::vector<int>{0, 1, 2, 3}), a);
+
+    std::vector<int> b(2);
+    any_output_iterator<int> to_vector = b.begin();
+    *to_vector = 5;
+    ++to_vector;
+    *to_vector = 6;
+    EXPECT_EQ((std::vector<int>{5, 6}), b);
+
+    any_output_iterator<int> empty;
+    EXPECT_THROW(*empty = 1, bad_any_iterator);
+}
+
+TEST(correctness, stream_file)
+{
+    char name[] = "any_iterator_stream_XXXXXX";
+    int fd = mkstemp(name);
+    ASSERT_NE(-1, fd);
+    close(fd);
+
+    size_t const size = 4 << 20;
+    {
+        std::ofstream file(name, std::ios::binary);
+        any_output_iterator<char> out = std::ostreambuf_iterator<char>(file);
+        for (size_t i = 0; i != size; ++i)
+            *out = static_cast<char>('a' + i % 26);
+    }
+
+    std::ifstream file(name, std::ios::binary);
+    size_t old_noa = number_of_allocations;
+    size_t count = 0;
+    unsigned checksum = 0;
+    {
+        any_input_iterator<char> i{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+        for (any_input_iterator<char> end; i != end; ++i)
+        {
+            ++count;
+            checksum = checksum * 31 + static_cast<unsigned char>(*i);
+        }
+    }
+    // nothing is buffered: the pair of istreambuf_iterators is allocated
+    // once (plus the type histogram entry with ANY_ITERATOR_STATS)
+    EXPECT_GE(old_noa + 2, number_of_allocations.load());
+    EXPECT_EQ(size, count);
+
+    unsigned expected = 0;
+    for (size_t i = 0; i != size; ++i)
+        expected = expected * 31 + static_cast<unsigned char>('a' + i % 26);
+    EXPECT_EQ(expected, checksum);
+
+    std::remove(name);
+}
+
+#if defined(__cpp_lib_concepts)
+TEST(correctness, single_pass_concepts)
+{
+    static_assert(std::input_iterator<any_input_iterator<int>>);
+    static_assert(std::sentinel_for<std::default_sentinel_t, any_input_iterator<int>>);
+    static_assert(std::output_iterator<any_output_iterator<int>, int>);
+
+    std::istringstream in("1 2 3");
+    std::vector<int> a;
+    std::ranges::copy(any_input_iterator<int>(std::istream_iterator<int>(in), std::istream_iterator<int>()), std::default_sentinel,
+                      any_output_iterator<int>(std::back_inserter(a)));
+    EXPECT_EQ((std::vector<int>{1, 2, 3}), a);
+}
+#endif
+
+// random access iterator over 0, 1, 2, ... that produces its values on the fly
+struct counting_iterator
+{
+    using value_type = int;
+    using iterator_category = std::random_access_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = int;
+
+    int value;
+
+    int operator*() const { return value; }
+    int operator[](std::ptrdiff_t n) const { return value + static_cast<int>(n); }
+    counting_iterator& operator++() { ++value; return *this; }
+    counting_iterator operator++(int) { return {value++}; }
+    counting_iterator& operator--() { --value; return *this; }
+    counting_iterator operator--(int) { return {value--}; }
+    counting_iterator& operator+=(std::ptrdiff_t n) { value += static_cast<int>(n); return *this; }
+    counting_iterator& operator-=(std::ptrdiff_t n) { value -= static_cast<int>(n); return *this; }
+    counting_iterator operator+(std::ptrdiff_t n) const { return {value + static_cast<int>(n)}; }
+    counting_iterator operator-(std::ptrdiff_t n) const { return {value - static_cast<int>(n)}; }
+    std::ptrdiff_t operator-(counting_iterator other) const { return value - other.value; }
+    bool operator==(counting_iterator other) const { return value == other.value; }
+    bool operator!=(counting_iterator other) const { return value != other.value; }
+    bool operator<(counting_iterator other) const { return value < other.value; }
+};
+
+TEST(correctness, reference_by_value)
+{
+    using iterator = any_random_access_iterator<int, default_storage, int>;
+    static_assert(std::is_same<int, iterator::reference>::value);
+    static_assert(std::is_same<void, iterator::pointer>::value);
+
+    iterator i = counting_iterator{0}, end = counting_iterator{10};
+    EXPECT_EQ(10, end - i);
+    EXPECT_EQ(3, i[3]);
+    EXPECT_EQ(45, std::accumulate(i, end, 0));
+    EXPECT_EQ(end, std::find(i, end, 10));
+
+    // lvalue iterators can be erased with by-value references too
+    std::vector<int> a = {1, 2, 3};
+    iterator j = a.begin();
+    a[0] = 5;
+    EXPECT_EQ(5, *j);
+    EXPECT_EQ(nullptr, j.contiguous_data());
+
+    any_random_access_range<int, default_storage, int> r(a);
+    EXPECT_EQ(nullptr, r.data());
+    int sum = 0;
+    r.for_each([&sum](int x) { sum += x; });
+    EXPECT_EQ(10, sum);
+
+    // an any_iterator with another reference type is wrapped
+    iterator k = any_random_access_iterator<int>(a.begin());
+    EXPECT_EQ(2, k[1]);
+}
+
+TEST(correctness, reference_proxy)
+{
+    std::vector<bool> a = {true, false, true, false};
+
+    using iterator = any_random_access_iterator<bool, default_storage, std::vector<bool>::reference>;
+    iterator first = a.begin(), last = a.end();
+    *first = false;
+    first[1] = true;
+    EXPECT_EQ((std::vector<bool>{false, true, true, false}), a);
+
+    std::fill(first + 2, last, true);
+    EXPECT_EQ(3, std::count(first, last, true));
+
+    any_forward_iterator<bool, default_storage, bool> i = a.cbegin(), end = a.cend();
+    EXPECT_EQ(3, std::count(i, end, true));
+}
+
+TEST(correctness, sentinel)
+{
+    char const* str = "hello";
+    any_forward_iterator<char const> i = str;
+    any_sentinel<char const> end(std::in_place_type<char const*>, null_sentinel());
+    EXPECT_EQ(typeid(null_sentinel), end.target_type());
+
+    // the sentinel is kept inline (the first construction above may
+    // allocate when ANY_ITERATOR_STATS records the types)
+    size_t old_noa = number_of_allocations;
+    any_sentinel<char const> end2(std::in_place_type<char const*>, null_sentinel());
+    EXPECT_EQ(old_noa, number_of_allocations.load());
+
+    std::string s;
+    for (; i != end; ++i)
+        s += *i;
+    EXPECT_EQ("hello", s);
+    EXPECT_TRUE(end == i);
+
+    std::vector<int> a = {1, 2, 3};
+    any_random_access_iterator<int> j = a.begin();
+    any_sentinel<int> vector_end(std::in_place_type<std::vector<int>::iterator>, a.end());
+    any_sentinel<int> copy = vector_end;
+    any_forward_iterator<int> k = j + 3;
+    EXPECT_FALSE(j == copy);
+    EXPECT_TRUE(k == copy);
+
+    any_sentinel<int> empty;
+    EXPECT_THROW((void)(any_forward_iterator<int>() == empty), bad_any_iterator);
+    empty = std::move(vector_end);
+    EXPECT_TRUE(k == empty);
+    EXPECT_EQ(typeid(void), vector_end.target_type());
+}
+
+#if defined(__cpp_lib_concepts)
+TEST(correctness, sentinel_concepts)
+{
+    static_assert(std::sentinel_for<any_sentinel<int>, any_forward_iterator<int>>);
+
+    std::list<int> a = {1, 2, 3, 4};
+    using counted = std::counted_iterator<std::list<int>::iterator>;
+    any_bidirectional_iterator<int> first = counted(a.begin(), 3);
+    any_sentinel<int> last(std::in_place_type<counted>, std::default_sentinel);
+    EXPECT_EQ(3, std::ranges::distance(first, last));
+    EXPECT_EQ(last, std::ranges::find(first, last, 4));
+}
+#endif
+
+TEST(correctness, range_empty)
+{
+    any_forward_range<int> a;
+    EXPECT_TRUE(a.empty());
+    EXPECT_EQ(0u, a.size());
+    EXPECT_EQ(nullptr, a.data());
+    any_forward_range<int> b = a;
+    any_forward_range<int> c = std::move(b);
+    c = a;
+}
+
+TEST(correctness, range_for)
+{
+    std::list<int> a = {1, 2, 3, 4, 5};
+    any_bidirectional_range<int> r = a;
+    EXPECT_FALSE(r.empty());
+    EXPECT_EQ(5u, r.size());
+    EXPECT_EQ(nullptr, r.data());
+
+    std::vector<int> b;
+    for (int x : r)
+        b.push_back(x);
+    EXPECT_TRUE(b == std::vector<int>({1, 2, 3, 4, 5}));
+
+    int sum = 0;
+    r.for_each([&](int x) { sum += x; });
+    EXPECT_EQ(15, sum);
+}
+
+TEST(correctness, range_contiguous)
+{
+    std::vector<int> a = {5, 3, 2, 4, 1};
+    any_random_access_range<int> r(a.begin(), a.end());
+    EXPECT_EQ(a.data(), r.data());
+    EXPECT_EQ(5u, r.size());
+
+    std::sort(r.begin(), r.end());
+    EXPECT_TRUE(a == std::vector<int>({1, 2, 3, 4, 5}));
+
+    r.for_each([](int& x) { x *= 2; });
+    EXPECT_TRUE(a == std::vector<int>({2, 4, 6, 8, 10}));
+}
+
+TEST(correctness, range_big)
+{
+    std::vector<int> a = {1, 2, 3, 4, 5};
+    {
+        any_forward_range<int> r(make_throwing_wrapper(a.begin()), make_throwing_wrapper(a.end()));
+        any_forward_range<int> s = r;
+        EXPECT_EQ(5u, s.size());
+        r = any_forward_range<int>();
+        EXPECT_TRUE(r.empty());
+        any_forward_iterator<int> i = s.begin();
+        EXPECT_EQ(2, *++i);
+    }
+    EXPECT_TRUE(throwing_wrapper_instances.empty());
+
+    std::deque<int> b = {1, 2, 3, 4, 5};
+    any_random_access_range<int> r = b;
+    size_t old_noa = number_of_allocations;
+    any_random_access_range<int> s = r;
+    EXPECT_EQ(old_noa + 1, number_of_allocations.load());
+    EXPECT_EQ(5u, s.size());
+}
+
+TEST(correctness, target)
+{
+    std::vector<int> a = {1, 2, 3};
+    std::list<int> b = {1, 2, 3};
+
+    any_random_access_iterator<int> i = a.begin() + 1;
+    EXPECT_TRUE(i.target_type() == typeid(std::vector<int>::iterator));
+    ASSERT_NE(nullptr, i.target<std::vector<int>::iterator>());
+    EXPECT_TRUE(*i.target<std::vector<int>::iterator>() == a.begin() + 1);
+    EXPECT_EQ(nullptr, i.target<int*>());
+
+    any_forward_iterator<int> const j = b.begin();
+    EXPECT_TRUE(j.target_type() == typeid(std::list<int>::iterator));
+    ASSERT_NE(nullptr, j.target<std::list<int>::iterator>());
+    EXPECT_TRUE(*j.target<std::list<int>::iterator>() == b.begin());
+
+    any_forward_iterator<int> k = i;
+    EXPECT_NE(nullptr, k.target<std::vector<int>::iterator>());
+    EXPECT_EQ(nullptr, k.target<std::list<int>::iterator>());
+
+    any_bidirectional_iterator<int> l;
+    EXPECT_TRUE(l.target_type() == typeid(void));
+    EXPECT_EQ(nullptr, l.target<std::list<int>::iterator>());
+}
+
+template <typename Iterator>
+int sum_until(Iterator first, Iterator last)
+{
+    int sum = 0;
+    for (; first != last; ++first)
+        sum += *first;
+    return sum;
+}
+
+TEST(correctness, visit)
+{
+    std::vector<int> a = {1, 2, 3};
+    std::list<int> b = {1, 2, 3};
+    using iterator = any_bidirectional_iterator<int>;
+
+    auto sum = [](iterator first, iterator const& last)
+    {
+        return first.visit<std::vector<int>::iterator, std::list<int>::iterator>([&](auto& it) -> std::pair<int, bool>
+        {
+            using inner = typename std::decay<decltype(it)>::type;
+            if constexpr (std::is_same<inner, iterator>::value)
+                return {sum_until(it, last), false};
+            else
+                return {sum_until(it, *last.template target<inner>()), true};
+        });
+    };
+
+    EXPECT_EQ(std::make_pair(6, true), sum(a.begin(), a.end()));
+    EXPECT_EQ(std::make_pair(6, true), sum(b.begin(), b.end()));
+    EXPECT_EQ(std::make_pair(6, false), sum(make_throwing_wrapper(a.begin()), make_throwing_wrapper(a.end())));
+}
+
+template <typename Container>
+Container shuffled_numbers(size_t n)
+{
+    std::vector<int> numbers(n);
+    for (size_t i = 0; i != n; ++i)
+        numbers[i] = static_cast<int>((i * 7919) % n);
+    return Container(numbers.begin(), numbers.end());
+}
+
+TEST(parallel, for_each_transform_reduce)
+{
+    any_iterator_parallel::thread_pool pool(4, 16);
+    std::vector<int> a = shuffled_numbers<std::vector<int>>(1000);
+    std::deque<int> b = shuffled_numbers<std::deque<int>>(1000);
+    using iterator = any_random_access_iterator<int, inline_storage<32>>;
+
+    any_iterator_parallel::for_each(pool, iterator(a.begin()), iterator(a.end()), [](int& x) { x *= 2; });
+    any_iterator_parallel::for_each(pool, iterator(b.begin()), iterator(b.end()), [](int& x) { x *= 2; });
+    EXPECT_EQ(999 * 1000, any_iterator_parallel::reduce(pool, iterator(a.begin()), iterator(a.end()), 0));
+    EXPECT_EQ(999 * 1000 + 1, any_iterator_parallel::reduce(pool, iterator(b.begin()), iterator(b.end()), 1));
+    EXPECT_EQ(5, any_iterator_parallel::reduce(pool, iterator(b.begin()), iterator(b.begin()), 5));
+
+    // chunks of deque const_iterators and of any_iterators
+    using const_iterator = any_random_access_iterator<int const, inline_storage<32>>;
+    EXPECT_EQ(999 * 1000, any_iterator_parallel::reduce(pool, const_iterator(b.cbegin()), const_iterator(b.cend()), 1) - 1);
+    EXPECT_EQ(999 * 1000, any_iterator_parallel::reduce(pool, const_iterator(b.begin()), const_iterator(b.end()), 0));
+    EXPECT_EQ(999 * 1000, any_iterator_parallel::reduce(pool, iterator(a.rbegin()), iterator(a.rend()), 0));
+
+    std::vector<int> c(1000);
+    std::deque<int> d(1000);
+    EXPECT_TRUE(c.end() == any_iterator_parallel::transform(pool, iterator(a.begin()), iterator(a.end()), c.begin(), [](int x) { return x + 1; }));
+    EXPECT_TRUE(iterator(d.end()) == any_iterator_parallel::transform(pool, iterator(b.begin()), iterator(b.end()), iterator(d.begin()), [](int x) { return x + 1; }));
+    for (size_t i = 0; i != 1000; ++i)
+    {
+        EXPECT_EQ(a[i] + 1, c[i]);
+        EXPECT_EQ(b[i] + 1, d[i]);
+    }
+}
+
+TEST(parallel, sort)
+{
+    any_iterator_parallel::thread_pool pool(3, 10);
+    std::vector<int> a = shuffled_numbers<std::vector<int>>(1001);
+    std::deque<int> b = shuffled_numbers<std::deque<int>>(1001);
+    using iterator = any_random_access_iterator<int, inline_storage<32>>;
+
+    any_iterator_parallel::sort(pool, iterator(a.begin()), iterator(a.end()));
+    any_iterator_parallel::sort(pool, iterator(b.begin()), iterator(b.end()), std::greater<>());
+    EXPECT_TRUE(std::is_sorted(a.begin(), a.end()));
+    EXPECT_TRUE(std::is_sorted(b.begin(), b.end(), std::greater<>()));
+    EXPECT_EQ(1000, a.back());
+    EXPECT_EQ(1000, b.front());
+
+    std::vector<int> c = shuffled_numbers<std::vector<int>>(100);
+    any_iterator_parallel::sort(iterator(c.begin()), iterator(c.end()));
+    EXPECT_TRUE(std::is_sorted(c.begin(), c.end()));
+
+    std::vector<int> d = shuffled_numbers<std::vector<int>>(1001);
+    any_iterator_parallel::sort(pool, iterator(d.rbegin()), iterator(d.rend()));
+    EXPECT_TRUE(std::is_sorted(d.rbegin(), d.rend()));
+}
+
+TEST(parallel, submit_failure)
+{
+    // the pool's queue fails to grow while the chunks are submitted
+    any_iterator_parallel::thread_pool pool(1, 1);
+    std::atomic<size_t> runs(0);
+    allocations_until_failure = 2;
+    EXPECT_THROW(any_iterator_impl::parallel::run_chunks(pool, 100, [&](size_t) { ++runs; }), std::bad_alloc);
+    allocations_until_failure = -1;
+    EXPECT_LT(0u, runs.load());
+    EXPECT_GT(100u, runs.load());
+
+    // the pool still works
+    runs = 0;
+    any_iterator_impl::parallel::run_chunks(pool, 100, [&](size_t) { ++runs; });
+    EXPECT_EQ(100u, runs.load());
+}
+
+TEST(parallel, shared_storage)
+{
+    any_iterator_parallel::thread_pool pool(4, 8);
+    std::deque<int> a = shuffled_numbers<std::deque<int>>(1001);
+    std::vector<int> b(1001);
+    // reverse deque iterators don't fit, the workers share their blocks
+    using iterator = any_random_access_iterator<int, shared_storage<default_storage, std::atomic<size_t>>>;
+    static_assert(any_iterator_impl::shares_heap_storage<std::deque<int>::reverse_iterator, shared_storage<default_storage, std::atomic<size_t>>>);
+
+    any_iterator_parallel::sort(pool, iterator(a.rbegin()), iterator(a.rend()));
+    EXPECT_TRUE(std::is_sorted(a.rbegin(), a.rend()));
+    EXPECT_EQ(500500, any_iterator_parallel::reduce(pool, iterator(a.rbegin()), iterator(a.rend()), 0));
+    any_iterator_parallel::transform(pool, iterator(a.rbegin()), iterator(a.rend()), iterator(b.rbegin()), [](int x) { return 2 * x; });
+    EXPECT_EQ(0, b.back());
+    EXPECT_EQ(2000, b.front());
+    EXPECT_EQ(1, any_iterator_parallel::find(pool, iterator(a.rbegin()), iterator(a.rend()), 1) - iterator(a.rbegin()));
+}
+
+TEST(parallel, find)
+{
+    any_iterator_parallel::thread_pool pool(4, 8);
+    std::deque<int> a(1000, 0);
+    a[700] = 1;
+    a[300] = 1;
+    a[900] = 1;
+    using iterator = any_random_access_iterator<int, inline_storage<32>>;
+
+    EXPECT_EQ(300, any_iterator_parallel::find(pool, iterator(a.begin()), iterator(a.end()), 1) - iterator(a.begin()));
+    EXPECT_TRUE(iterator(a.end()) == any_iterator_parallel::find(pool, iterator(a.begin()), iterator(a.end()), 2));
+}
+
+TEST(parallel, exceptions)
+{
+    any_iterator_parallel::thread_pool pool(2, 4);
+    std::vector<int> a(100);
+    EXPECT_THROW(any_iterator_parallel::for_each(pool, any_random_access_iterator<int>(a.begin()), any_random_access_iterator<int>(a.end()),
+                                                 [](int) { throw std::runtime_error("chunk"); }),
+                 std::runtime_error);
+}
+
+// every kernel set the CPU supports against the scalar kernels, at sizes
+// around the vector widths and beyond the overflow limit of 8 bit counters
+template <typename T>
+void check_simd_kernels()
+{
+    using namespace any_iterator_simd;
+    std::mt19937 rng(42);
+    for (size_t n : {0, 1, 3, 15, 16, 17, 31, 32, 33, 100, 1000, 5000})
+    {
+        std::vector<T> a(n);
+        for (T& x : a)
+            x = static_cast<T>(rng() % 7);
+        T const* p = a.data();
+
+        auto check = [&](auto kernels)
+        {
+            using scalar = scalar_kernels<T>;
+            EXPECT_EQ(scalar::sum(p, n), kernels.sum(p, n));
+            EXPECT_EQ(scalar::count(p, n, 3), kernels.count(p, n, 3));
+            EXPECT_EQ(scalar::find(p, n, 5), kernels.find(p, n, 5));
+            EXPECT_EQ(n, kernels.find(p, n, 7));
+            if (n != 0)
+            {
+                EXPECT_EQ(scalar::min(p, n), kernels.min(p, n));
+                EXPECT_EQ(scalar::max(p, n), kernels.max(p, n));
+            }
+        };
+
+#if defined(ANY_ITERATOR_SIMD_VECTORS)
+        check(vector_kernels<16, T>());
+#endif
+#if defined(ANY_ITERATOR_SIMD_X86)
+        if (has_avx2())
+            check(avx2_kernels<T>());
+#endif
+    }
+}
+
+TEST(simd, kernels)
+{
+    check_simd_kernels<signed char>();
+    check_simd_kernels<unsigned char>();
+    check_simd_kernels<short>();
+    check_simd_kernels<int>();
+    check_simd_kernels<unsigned>();
+    check_simd_kernels<long long>();
+    check_simd_kernels<float>();
+    check_simd_kernels<double>();
+}
+
+TEST(simd, any_iterator)
+{
+    std::vector<int> a(1000);
+    std::iota(a.begin(), a.end(), -500);
+    std::deque<int> b(a.begin(), a.end());
+    std::list<int> c(a.begin(), a.end());
+
+    using random_access_iterator = any_random_access_iterator<int const>;
+    using forward_iterator = any_forward_iterator<int>;
+    random_access_iterator const first(b.begin()), last(b.end());
+
+    EXPECT_EQ(-500, any_iterator_simd::sum(random_access_iterator(a.begin()), random_access_iterator(a.end())));
+    EXPECT_EQ(-500, any_iterator_simd::sum(first, last));
+    EXPECT_EQ(-500, any_iterator_simd::sum(forward_iterator(c.begin()), forward_iterator(c.end())));
+    EXPECT_EQ(0, any_iterator_simd::sum(first, first));
+
+    EXPECT_EQ(-500, any_iterator_simd::min(first, last));
+    EXPECT_EQ(499, any_iterator_simd::max(forward_iterator(c.begin()), forward_iterator(c.end())));
+    EXPECT_EQ(1, any_iterator_simd::count(first, last, 7));
+    EXPECT_EQ(0, any_iterator_simd::count(forward_iterator(c.begin()), forward_iterator(c.end()), 500));
+
+    EXPECT_TRUE(any_iterator_simd::find(first, last, 200) == first + 700);
+    EXPECT_TRUE(any_iterator_simd::find(first, last, 500) == last);
+    EXPECT_TRUE(any_iterator_simd::find(random_access_iterator(a.begin()), random_access_iterator(a.end()), -1)
+             == random_access_iterator(a.begin() + 499));
+    forward_iterator i = any_iterator_simd::find(forward_iterator(c.begin()), forward_iterator(c.end()), 0);
+    EXPECT_EQ(0, *i);
+    EXPECT_EQ(1, *++i);
+    EXPECT_TRUE(any_iterator_simd::find(forward_iterator(c.begin()), forward_iterator(c.end()), 1000) == forward_iterator(c.end()));
+
+    std::vector<double> d = {0.5, -1.5, 2.0};
+    EXPECT_EQ(1.0, any_iterator_simd::sum(any_forward_iterator<double>(d.begin()), any_forward_iterator<double>(d.end())));
+}
+
+// endless source counting up from 0 that throws when it gets to throw_at
+struct counting_source
+{
+    using value_type = int;
+    using difference_type = std::ptrdiff_t;
+    using pointer = int const*;
+    using reference = int const&;
+    using iterator_category = std::input_iterator_tag;
+
+    int n = 0;
+    int throw_at = -1;
+    // every that many elements the source stalls for 20 ms
+    int stall_every = 0;
+    std::shared_ptr<std::atomic<int> > reads = std::make_shared<std::atomic<int> >(0);
+
+    int const& operator*() const
+    {
+        if (n == throw_at)
+            throw std::runtime_error("source");
+        if (stall_every && n % stall_every == stall_every - 1)
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        ++*reads;
+        return n;
+    }
+    counting_source& operator++() { ++n; return *this; }
+    counting_source operator++(int) { counting_source old = *this; ++n; return old; }
+    friend bool operator==(counting_source const&, null_sentinel) { return false; }
+};
+
+TEST(readahead, spsc_ring)
+{
+    any_iterator_readahead::spsc_ring<std::string> ring(3);
+    EXPECT_EQ(4u, ring.capacity());
+
+    std::string s;
+    EXPECT_FALSE(ring.try_pop(s));
+    for (int i = 0; i != 4; ++i)
+        EXPECT_TRUE(ring.try_push(std::to_string(i)));
+    std::string five = "5";
+    EXPECT_FALSE(ring.try_push(std::move(five)));
+    EXPECT_EQ("5", five);
+
+    EXPECT_TRUE(ring.try_pop(s));
+    EXPECT_EQ("0", s);
+    EXPECT_TRUE(ring.try_push(std::move(five)));
+    for (char const* expected : {"1", "2", "3", "5"})
+    {
+        EXPECT_TRUE(ring.try_pop(s));
+        EXPECT_EQ(expected, s);
+    }
+    EXPECT_FALSE(ring.try_pop(s));
+
+    // elements left in the ring are destroyed with it
+    ring.try_push(std::string(100, 'x'));
+}
+
+TEST(readahead, elements)
+{
+    std::list<int> a(10000);
+    std::iota(a.begin(), a.end(), 0);
+    for (size_t depth : {1, 3, 64})
+    {
+        any_input_iterator<int> i = any_iterator_readahead::make_iterator<int>(any_forward_iterator<int>(a.begin()),
+                                                                              any_forward_iterator<int>(a.end()), depth);
+        long long sum = 0;
+        int expected = 0;
+        for (; !i.at_end(); ++i, ++expected)
+        {
+            EXPECT_EQ(expected, *i);
+            sum += *i;
+        }
+        EXPECT_EQ(10000, expected);
+        EXPECT_EQ(49995000, sum);
+    }
+
+    std::vector<std::string> b = {"a", "bc", "def"};
+    std::string joined;
+    for (any_input_iterator<std::string> i = any_iterator_readahead::make_iterator<std::string>(b.begin(), b.end()), end; i != end; ++i)
+        joined += *i;
+    EXPECT_EQ("abcdef", joined);
+
+    std::vector<int> empty;
+    EXPECT_TRUE(any_iterator_readahead::make_iterator<int>(empty.begin(), empty.end()).at_end());
+}
+
+TEST(readahead, cancellation)
+{
+    counting_source source;
+    {
+        any_input_iterator<int> i = any_iterator_readahead::make_iterator<int>(source, null_sentinel(), 16);
+        EXPECT_EQ(0, *i);
+        ++i;
+        EXPECT_EQ(1, *i);
+    }
+    // the producer of the endless source stopped with the iterator
+    int reads = *source.reads;
+    EXPECT_LE(reads, 2 + 16 + 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_EQ(reads, *source.reads);
+}
+
+TEST(readahead, parking)
+{
+    // the producer sleeps while the ring is full and the consumer is busy
+    // elsewhere, and is woken to stop
+    counting_source endless;
+    {
+        any_input_iterator<int> i = any_iterator_readahead::make_iterator<int>(endless, null_sentinel(), 4);
+        EXPECT_EQ(0, *i);
+        std::clock_t before = std::clock();
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        EXPECT_LT(std::clock() - before, CLOCKS_PER_SEC / 20);
+        ++i;
+        EXPECT_EQ(1, *i);
+    }
+
+    // the consumer sleeps while the source stalls
+    counting_source slow;
+    slow.stall_every = 10;
+    any_input_iterator<int> i = any_iterator_readahead::make_iterator<int>(slow, null_sentinel(), 4);
+    std::clock_t before = std::clock();
+    for (int expected = 0; expected != 50; ++expected, ++i)
+        EXPECT_EQ(expected, *i);
+    EXPECT_LT(std::clock() - before, CLOCKS_PER_SEC / 20);
+}
+
+TEST(readahead, exceptions)
+{
+    counting_source source;
+    source.throw_at = 100;
+    any_input_iterator<int> i = any_iterator_readahead::make_iterator<int>(source, null_sentinel(), 8);
+    for (int expected = 0; expected != 99; ++expected, ++i)
+        EXPECT_EQ(expected, *i);
+    EXPECT_EQ(99, *i);
+    EXPECT_THROW(++i, std::runtime_error);
+    EXPECT_TRUE(i.at_end());
+}
+
+#ifdef ANY_ITERATOR_STATS
+namespace stats = any_iterator_impl::stats;
+
+size_t stats_op(stats::summary const& s, stats::op o)
+{
+    return s.ops[static_cast<size_t>(o)];
+}
+
+size_t stats_allocation(stats::summary const& s, stats::allocation a)
+{
+    return s.allocations[static_cast<size_t>(a)];
+}
+
+TEST(stats, ops)
+{
+    std::vector<int> a = {1, 2, 3};
+    stats::summary before = stats::snapshot();
+    {
+        any_forward_iterator<int> i = a.begin(), e = a.end();
+        for (; i != e; ++i)
+            *i;
+    }
+    stats::summary after = stats::snapshot();
+
+    EXPECT_EQ(3u, stats_op(after, stats::op::deref) - stats_op(before, stats::op::deref));
+    EXPECT_EQ(3u, stats_op(after, stats::op::preinc) - stats_op(before, stats::op::preinc));
+    EXPECT_EQ(4u, stats_op(after, stats::op::eq) - stats_op(before, stats::op::eq));
+    EXPECT_EQ(2u, stats_op(after, stats::op::destroy) - stats_op(before, stats::op::destroy));
+}
+
+TEST(stats, fused_ops)
+{
+    std::list<int> a = {1, 2, 3};
+    std::vector<int> b;
+    stats::summary before = stats::snapshot();
+    any_iterator_impl::copy(any_forward_iterator<int>(a.begin()), any_forward_iterator<int>(a.end()), std::back_inserter(b));
+    stats::summary after = stats::snapshot();
+
+    EXPECT_EQ(a.size(), b.size());
+    EXPECT_EQ(4u, stats_op(after, stats::op::next) - stats_op(before, stats::op::next));
+    EXPECT_EQ(0u, stats_op(after, stats::op::deref) - stats_op(before, stats::op::deref));
+    EXPECT_EQ(0u, stats_op(after, stats::op::preinc) - stats_op(before, stats::op::preinc));
+    EXPECT_EQ(0u, stats_op(after, stats::op::eq) - stats_op(before, stats::op::eq));
+}
+
+TEST(stats, prefetch)
+{
+    std::list<int> a = {1, 2, 3, 4, 5};
+    std::vector<int> b;
+    stats::summary before = stats::snapshot();
+    for_each_prefetched(any_forward_iterator<int>(a.begin()), any_forward_iterator<int>(a.end()), 2,
+                        [&](int x) { b.push_back(x); });
+    stats::summary after = stats::snapshot();
+
+    EXPECT_EQ(a.size(), b.size());
+    // one call per element and one at the end, plus the look-ahead start
+    EXPECT_EQ(6u, stats_op(after, stats::op::next_prefetched) - stats_op(before, stats::op::next_prefetched));
+    EXPECT_EQ(2u, stats_op(after, stats::op::next) - stats_op(before, stats::op::next));
+    for (stats::op o : {stats::op::deref, stats::op::preinc, stats::op::eq, stats::op::deref_inc})
+        EXPECT_EQ(0u, stats_op(after, o) - stats_op(before, o));
+}
+
+TEST(stats, parallel_chunks)
+{
+    any_iterator_parallel::thread_pool pool(2, 16);
+    std::deque<int> a(1000, 1);
+    using iterator = any_random_access_iterator<int, inline_storage<32>>;
+    stats::summary before = stats::snapshot();
+    any_iterator_parallel::for_each(pool, iterator(a.begin()), iterator(a.end()), [](int& x) { ++x; });
+    stats::summary after = stats::snapshot();
+
+    EXPECT_EQ(1000, std::count(a.begin(), a.end(), 2));
+    EXPECT_EQ(0u, stats_op(after, stats::op::deref) - stats_op(before, stats::op::deref));
+    EXPECT_EQ(0u, stats_op(after, stats::op::preinc) - stats_op(before, stats::op::preinc));
+}
+
+TEST(stats, algorithms)
+{
+    std::list<int> a = {1, 2, 3};
+    stats::summary before = stats::snapshot();
+    any_forward_iterator<int> i = any_iterator_impl::find(any_forward_iterator<int>(a.begin()), any_forward_iterator<int>(a.end()), 3);
+    stats::summary after = stats::snapshot();
+
+    EXPECT_EQ(3, *i);
+    EXPECT_EQ(0u, stats_op(after, stats::op::deref) - stats_op(before, stats::op::deref));
+    EXPECT_EQ(0u, stats_op(after, stats::op::preinc) - stats_op(before, stats::op::preinc));
+    EXPECT_EQ(0u, stats_op(after, stats::op::eq) - stats_op(before, stats::op::eq));
+}
+
+TEST(stats, allocations)
+{
+    std::vector<int> a = {1, 2, 3};
+    using inner = throwing_wrapper<std::vector<int>::iterator>;
+    std::string name = typeid(inner).name();
+    stats::summary before = stats::snapshot();
+    {
+        any_forward_iterator<int> i = make_throwing_wrapper(a.begin());
+        any_forward_iterator<int> j = i;
+        i++;
+        any_forward_iterator<int> k = a.begin();
+    }
+    stats::summary after = stats::snapshot();
+
+    EXPECT_EQ(1u, stats_allocation(after, stats::allocation::construct) - stats_allocation(before, stats::allocation::construct));
+    EXPECT_EQ(1u, stats_allocation(after, stats::allocation::copy) - stats_allocation(before, stats::allocation::copy));
+    EXPECT_EQ(1u, stats_allocation(after, stats::allocation::postinc) - stats_allocation(before, stats::allocation::postinc));
+    EXPECT_EQ(1u, after.types[name].heap_constructions - before.types[name].heap_constructions);
+    EXPECT_EQ(0u, after.types[name].inline_constructions - before.types[name].inline_constructions);
+    EXPECT_LT(0u, after.types[typeid(std::vector<int>::iterator).name()].inline_constructions);
+}
+
+TEST(stats, threads)
+{
+    std::vector<int> a = {1, 2, 3};
+    stats::summary before = stats::snapshot();
+    std::thread t([&]
+    {
+        any_forward_iterator<int> i = a.begin();
+        ++i;
+    });
+    t.join();
+    stats::summary after = stats::snapshot();
+
+    EXPECT_EQ(1u, stats_op(after, stats::op::preinc) - stats_op(before, stats::op::preinc));
+
+    std::ostringstream os;
+    stats::dump(os);
+    EXPECT_NE(std::string::npos, os.str().find("preinc"));
+}
+#endif
+
+// these come from the any_iterator_instances library otherwise
+#if !defined(ANY_ITERATOR_EXTERN_TEMPLATES)
 template struct any_iterator<int, std::forward_iterator_tag>;
 template struct any_iterator<int, std::bidirectional_iterator_tag>;
 template struct any_iterator<int, std::random_access_iterator_tag>;
+#endif
+template struct any_iterator<int, std::random_access_iterator_tag, inline_storage<32>>;
+template struct any_iterator<int, std::random_access_iterator_tag, pooled_storage<8>>;
+template struct any_iterator<int, std::random_access_iterator_tag, hot_ops_storage<default_storage>>;
+template struct any_iterator<int, std::random_access_iterator_tag, default_storage, int>;
+template struct any_range<int, std::random_access_iterator_tag>;
 
 int main(int argc, char *argv[])
 {